@@ -0,0 +1,556 @@
+/*
+  ==============================================================================
+
+    Offline batch renderer for DigitalDelay.
+
+    Streams audio files through independent DigitalDelayAudioProcessor
+    instances on a thread pool, using a state chunk saved by
+    getStateInformation() so every file is rendered with the same settings.
+
+    Usage:
+        BatchRenderer --state=preset.bin --out=renders [--bpm=120]
+                      [--block=512] [--tail=2] [--threads=N] [--io-threads=N]
+                      file1.wav file2.wav ...
+
+    With --bench it instead times processBlock on noise for a list of
+    parameter scenarios and prints the cost in ns per sample frame:
+        BatchRenderer --bench [--state=preset.bin] [--block=512]
+                      [--rate=48000] [--seconds=10] [--scenario=name]
+
+    Built in the RealtimeCheck configuration (Linux), either mode also traps
+    every allocation, lock and blocking call made inside processBlock, prints
+    the offending stacks at the end and fails if there were any. A short
+    bench run covers every scenario:
+        BatchRenderer --bench --seconds=0.5
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/PluginProcessor.h"
+#include "../../Source/RealtimeSafetyChecker.h"
+
+namespace
+{
+    //==============================================================================
+    struct RenderSettings
+    {
+        juce::MemoryBlock state;
+        juce::File outputDir;
+        double bpm{ 120.0 };
+        int    blockSize{ 512 };
+        double tailSeconds{ 2.0 };
+        int    readAheadSamples{ 1 << 16 };
+        int    writeBehindSamples{ 1 << 16 };
+    };
+
+    struct RenderResult
+    {
+        juce::String name;
+        juce::String error;
+        double audioSeconds{ 0.0 };
+        double wallSeconds{ 0.0 };
+        double dspSeconds{ 0.0 };
+        bool   succeeded{ false };
+    };
+
+    //==============================================================================
+    // There is no host offline, so the tempo synced steps need a fixed tempo
+    class FixedTempoPlayHead : public juce::AudioPlayHead
+    {
+    public:
+        explicit FixedTempoPlayHead(double tempo) : bpm(tempo) {}
+
+        bool getCurrentPosition(CurrentPositionInfo& result) override
+        {
+            result.resetToDefault();
+            result.bpm = bpm;
+            result.timeInSamples = timeInSamples;
+            result.timeInSeconds = timeInSeconds;
+            result.isPlaying = true;
+            return true;
+        }
+
+        double bpm;
+        juce::int64 timeInSamples{ 0 };
+        double timeInSeconds{ 0.0 };
+    };
+
+    //==============================================================================
+    class RenderJob : public juce::ThreadPoolJob
+    {
+    public:
+        RenderJob(const juce::File& input, const RenderSettings& renderSettings,
+            juce::TimeSliceThread& readAheadThread, juce::TimeSliceThread& writeBehindThread,
+            RenderResult& renderResult)
+            : juce::ThreadPoolJob(input.getFileName()), inputFile(input), settings(renderSettings),
+              readThread(readAheadThread), writeThread(writeBehindThread), result(renderResult)
+        {
+            result.name = inputFile.getFileName();
+        }
+
+        JobStatus runJob() override
+        {
+            const auto startTime = juce::Time::getMillisecondCounterHiRes();
+            result.error = render();
+            result.succeeded = result.error.isEmpty();
+            result.wallSeconds = (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+            return jobHasFinished;
+        }
+
+    private:
+        juce::String render()
+        {
+            juce::AudioFormatManager formatManager;
+            formatManager.registerBasicFormats();
+
+            std::unique_ptr<juce::AudioFormatReader> fileReader(formatManager.createReaderFor(inputFile));
+            if (fileReader == nullptr)
+                return "could not open " + inputFile.getFullPathName();
+
+            const double sampleRate = fileReader->sampleRate;
+            const int numFileChannels = (int) fileReader->numChannels;
+            const juce::int64 fileLength = fileReader->lengthInSamples;
+            const int numChannels = 2;
+
+            // read-ahead happens on the shared time slice thread, the job only blocks if it overtakes it
+            juce::BufferingAudioReader reader(fileReader.release(), readThread, settings.readAheadSamples);
+            reader.setReadTimeout(-1);
+
+            auto outputFile = settings.outputDir.getChildFile(inputFile.getFileNameWithoutExtension() + "_delay.wav");
+            outputFile.deleteFile();
+            std::unique_ptr<juce::FileOutputStream> stream(outputFile.createOutputStream());
+            if (stream == nullptr || stream->failedToOpen())
+                return "could not create " + outputFile.getFullPathName();
+
+            juce::WavAudioFormat wavFormat;
+            std::unique_ptr<juce::AudioFormatWriter> fileWriter(wavFormat.createWriterFor(stream.get(),
+                sampleRate, (unsigned int) numChannels, 24, {}, 0));
+            if (fileWriter == nullptr)
+                return "could not create a writer for " + outputFile.getFullPathName();
+            stream.release();
+
+            // write-behind: the job hands blocks to the fifo and the time slice thread does the disk I/O
+            juce::AudioFormatWriter::ThreadedWriter writer(fileWriter.release(), writeThread, settings.writeBehindSamples);
+
+            DigitalDelayAudioProcessor processor;
+            FixedTempoPlayHead playHead(settings.bpm);
+            processor.setPlayConfigDetails(numChannels, numChannels, sampleRate, settings.blockSize);
+            processor.setNonRealtime(true);
+            processor.setPlayHead(&playHead);
+            processor.setStateInformation(settings.state.getData(), (int) settings.state.getSize());
+            processor.prepareToPlay(sampleRate, settings.blockSize);
+
+            juce::AudioBuffer<float> buffer(numChannels, settings.blockSize);
+            juce::MidiBuffer midiMessages;
+            const juce::int64 totalLength = fileLength + (juce::int64) (settings.tailSeconds * sampleRate);
+            juce::int64 dspTicks = 0;
+
+            for (juce::int64 position = 0; position < totalLength; position += settings.blockSize)
+            {
+                if (shouldExit())
+                    return "cancelled";
+
+                const int numSamples = (int) juce::jmin((juce::int64) settings.blockSize, totalLength - position);
+                buffer.setSize(numChannels, numSamples, false, false, true);
+                buffer.clear();
+
+                // a mono file is copied to both channels, reads past the end are left silent
+                if (position < fileLength)
+                    reader.read(&buffer, 0, numSamples, position, true, numFileChannels > 1 || numChannels > 1);
+
+                const auto startTicks = juce::Time::getHighResolutionTicks();
+                processor.processBlock(buffer, midiMessages);
+                dspTicks += juce::Time::getHighResolutionTicks() - startTicks;
+
+                playHead.timeInSamples += numSamples;
+                playHead.timeInSeconds = playHead.timeInSamples / sampleRate;
+
+                while (! writer.write(buffer.getArrayOfReadPointers(), numSamples))
+                    juce::Thread::sleep(1);
+            }
+
+            processor.releaseResources();
+            processor.setPlayHead(nullptr);
+
+            result.audioSeconds = totalLength / sampleRate;
+            result.dspSeconds = juce::Time::highResolutionTicksToSeconds(dspTicks);
+            return {};
+        }
+
+        juce::File inputFile;
+        const RenderSettings& settings;
+        juce::TimeSliceThread& readThread;
+        juce::TimeSliceThread& writeThread;
+        RenderResult& result;
+
+        JUCE_DECLARE_NON_COPYABLE(RenderJob)
+    };
+
+    //==============================================================================
+    void printUsage()
+    {
+        std::cout << "Usage: BatchRenderer --state=preset.bin --out=folder [--bpm=120] [--block=512]" << std::endl
+                  << "                     [--tail=2] [--threads=N] [--io-threads=N] file1.wav file2.wav ..." << std::endl
+                  << "       BatchRenderer --bench [--state=preset.bin] [--block=512] [--rate=48000]" << std::endl
+                  << "                     [--seconds=10] [--scenario=name]" << std::endl;
+    }
+
+    juce::String formatResult(const RenderResult& r)
+    {
+        if (! r.succeeded)
+            return r.name + ": FAILED (" + r.error + ")";
+
+        return r.name + ": " + juce::String(r.audioSeconds, 2) + " s audio in "
+            + juce::String(r.wallSeconds, 2) + " s, realtime x" + juce::String(r.audioSeconds / juce::jmax(r.wallSeconds, 1.0e-9), 1)
+            + " (dsp only x" + juce::String(r.audioSeconds / juce::jmax(r.dspSeconds, 1.0e-9), 1) + ")";
+    }
+
+    //==============================================================================
+    struct BenchmarkSettings
+    {
+        juce::MemoryBlock state;
+        double sampleRate{ 48000.0 };
+        int    blockSize{ 512 };
+        double seconds{ 10.0 };
+    };
+
+    struct BenchmarkScenario
+    {
+        juce::String name;
+        std::vector<std::pair<juce::String, float>> parameters;
+        std::function<void (DigitalDelayAudioProcessor&)> setup;
+        bool bypassed;
+        int notesPerBlock;  // division notes spread over each block, as a fast performance gesture would
+    };
+
+    // parameter values are in their real units, not normalised
+    std::vector<BenchmarkScenario> getBenchmarkScenarios()
+    {
+        return {
+            { "forward",            {}, nullptr, false },
+            { "forward (staged)",   {}, [](DigitalDelayAudioProcessor& p) { p.setFusedProcessingEnabled(false); }, false },
+            { "bypassed",           {}, nullptr, true },
+            { "bypassed (input)",   { { "BypassFeedsDelay", 1.0f } }, nullptr, true },
+            { "reverse",            { { "Reverse", 1.0f } }, nullptr, false },
+            { "granular 8 grains",  { { "Granular", 1.0f }, { "GrainSize", 200.0f }, { "GrainDensity", 40.0f } }, nullptr, false },
+            { "granular 16 grains", { { "Granular", 1.0f }, { "GrainSize", 200.0f }, { "GrainDensity", 80.0f } }, nullptr, false },
+            { "granular 32 grains", { { "Granular", 1.0f }, { "GrainSize", 200.0f }, { "GrainDensity", 160.0f } }, nullptr, false },
+            { "granular 64 grains", { { "Granular", 1.0f }, { "GrainSize", 200.0f }, { "GrainDensity", 320.0f } }, nullptr, false },
+            { "eco half",           { { "Eco", 1.0f } }, nullptr, false },
+            { "eco quarter",        { { "Eco", 2.0f } }, nullptr, false },
+            { "eco quarter (staged)", { { "Eco", 2.0f } }, [](DigitalDelayAudioProcessor& p) { p.setFusedProcessingEnabled(false); }, false },
+            { "granular 32 eco half", { { "Granular", 1.0f }, { "GrainSize", 200.0f }, { "GrainDensity", 160.0f }, { "Eco", 1.0f } }, nullptr, false },
+            { "spectral 512",       { { "Spectral", 1.0f }, { "SpectralSize", 0.0f } }, nullptr, false },
+            { "spectral 1024",      { { "Spectral", 1.0f }, { "SpectralSize", 1.0f } }, nullptr, false },
+            { "spectral 2048",      { { "Spectral", 1.0f }, { "SpectralSize", 2.0f } }, nullptr, false },
+            { "diffusion wet 1 stage",     { { "Diffusion", 1.0f }, { "DiffusionStages", 1.0f } }, nullptr, false },
+            { "diffusion wet 2 stages",    { { "Diffusion", 1.0f }, { "DiffusionStages", 2.0f } }, nullptr, false },
+            { "diffusion wet 4 stages",    { { "Diffusion", 1.0f }, { "DiffusionStages", 4.0f } }, nullptr, false },
+            { "diffusion wet 8 stages",    { { "Diffusion", 1.0f }, { "DiffusionStages", 8.0f } }, nullptr, false },
+            { "diffusion feedback 4 stages", { { "Diffusion", 2.0f }, { "DiffusionStages", 4.0f } }, nullptr, false },
+            { "width 150%",         { { "Width", 1.5f }, { "Pan", 0.3f } }, nullptr, false },
+            { "width 150% (staged)", { { "Width", 1.5f }, { "Pan", 0.3f } }, [](DigitalDelayAudioProcessor& p) { p.setFusedProcessingEnabled(false); }, false },
+            { "midi 4 notes/block",  {}, nullptr, false, 4 },
+            { "midi 16 notes/block", {}, nullptr, false, 16 },
+        };
+    }
+
+    void setParameter(DigitalDelayAudioProcessor& processor, const juce::String& parameterID, float value)
+    {
+        if (auto* parameter = processor.tree.getParameter(parameterID))
+            parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+        else
+            std::cerr << "Unknown parameter " << parameterID << std::endl;
+    }
+
+    juce::String runScenario(const BenchmarkScenario& scenario, const BenchmarkSettings& settings, double& nanosPerSample)
+    {
+        const int numChannels = 2;
+        DigitalDelayAudioProcessor processor;
+        FixedTempoPlayHead playHead(120.0);
+        processor.setPlayConfigDetails(numChannels, numChannels, settings.sampleRate, settings.blockSize);
+        processor.setPlayHead(&playHead);
+        if (settings.state.getSize() > 0)
+            processor.setStateInformation(settings.state.getData(), (int) settings.state.getSize());
+        for (auto& parameter : scenario.parameters)
+            setParameter(processor, parameter.first, parameter.second);
+        if (scenario.setup)
+            scenario.setup(processor);
+        processor.prepareToPlay(settings.sampleRate, settings.blockSize);
+
+        juce::Random random(0x5eed);
+        juce::AudioBuffer<float> input(numChannels, settings.blockSize);
+        for (int i = 0; i < numChannels; ++i)
+            for (int j = 0; j < settings.blockSize; ++j)
+                input.setSample(i, j, 0.5f * random.nextFloat() - 0.25f);
+
+        juce::AudioBuffer<float> buffer(numChannels, settings.blockSize);
+        juce::MidiBuffer midiMessages;
+        const int numBlocks = juce::jmax(1, juce::roundToInt(settings.seconds * settings.sampleRate / settings.blockSize));
+
+        // the first couple of seconds fill the delay line and reach a steady state before timing starts
+        const int numWarmUpBlocks = juce::roundToInt(2.0 * settings.sampleRate / settings.blockSize);
+        juce::int64 ticks = 0;
+
+        for (int block = 0; block < numWarmUpBlocks + numBlocks; ++block)
+        {
+            for (int i = 0; i < numChannels; ++i)
+                buffer.copyFrom(i, 0, input, i, 0, settings.blockSize);
+
+            midiMessages.clear();
+            for (int note = 0; note < scenario.notesPerBlock; ++note)
+                midiMessages.addEvent(juce::MidiMessage::noteOn(1, 36 + (block + note) % 16, 1.0f),
+                    note * settings.blockSize / scenario.notesPerBlock);
+
+            const auto startTicks = juce::Time::getHighResolutionTicks();
+            if (scenario.bypassed)
+                processor.processBlockBypassed(buffer, midiMessages);
+            else
+                processor.processBlock(buffer, midiMessages);
+            if (block >= numWarmUpBlocks)
+                ticks += juce::Time::getHighResolutionTicks() - startTicks;
+
+            playHead.timeInSamples += settings.blockSize;
+        }
+
+        processor.releaseResources();
+        processor.setPlayHead(nullptr);
+
+        nanosPerSample = juce::Time::highResolutionTicksToSeconds(ticks) * 1.0e9 / ((double) numBlocks * settings.blockSize);
+        auto line = scenario.name.paddedRight(' ', 24) + juce::String(nanosPerSample, 2).paddedLeft(' ', 10) + " ns/sample"
+            + "   realtime x" + juce::String(1.0e9 / (settings.sampleRate * nanosPerSample), 0);
+
+        if (processor.getNumActiveGrains() > 0)
+            line << "   " << juce::String(nanosPerSample / processor.getNumActiveGrains(), 2) << " ns/sample/grain";
+
+        if (processor.getLatencySamples() > 0)
+            line << "   " << juce::String(nanosPerSample / numChannels, 2) << " ns/sample/channel, latency "
+                 << processor.getLatencySamples();
+
+        const auto eco = processor.getEcoStats();
+        if (eco.factor > 1)
+            line << "   delay line " << juce::File::descriptionOfSizeInBytes((juce::int64) eco.delayLineBytes)
+                 << " (" << juce::File::descriptionOfSizeInBytes((juce::int64) eco.delayLineBytesSaved) << " saved)";
+
+        return line;
+    }
+
+    // the wet stage on its own: the old per-channel balance gains against the mid/side matrix that replaced them
+    juce::String runWetStageBenchmark(const BenchmarkSettings& settings)
+    {
+        const int numSamples = settings.blockSize;
+        juce::Random random(0x5eed);
+        juce::AudioBuffer<float> wet(2, numSamples), output(2, numSamples);
+        for (int i = 0; i < 2; ++i)
+            for (int j = 0; j < numSamples; ++j)
+                wet.setSample(i, j, 0.5f * random.nextFloat() - 0.25f);
+        output.clear();
+
+        const int numBlocks = juce::jmax(1, juce::roundToInt(settings.seconds * settings.sampleRate / numSamples));
+        const StereoMatrix startMatrix = StereoMatrix::fromWidthAndPan(0.7f, 1.5f, 0.2f);
+        const StereoMatrix endMatrix = StereoMatrix::fromWidthAndPan(0.7f, 1.4f, 0.3f);
+
+        auto perChannelStart = juce::Time::getHighResolutionTicks();
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            output.addFromWithRamp(0, 0, wet.getReadPointer(0), numSamples, startMatrix.ll, endMatrix.ll);
+            output.addFromWithRamp(1, 0, wet.getReadPointer(1), numSamples, startMatrix.rr, endMatrix.rr);
+        }
+        const auto perChannelTicks = juce::Time::getHighResolutionTicks() - perChannelStart;
+
+        auto matrixStart = juce::Time::getHighResolutionTicks();
+        for (int block = 0; block < numBlocks; ++block)
+            VectorOps::applyStereoMatrix(output.getWritePointer(0), output.getWritePointer(1),
+                wet.getReadPointer(0), wet.getReadPointer(1), numSamples, startMatrix, endMatrix, true);
+        const auto matrixTicks = juce::Time::getHighResolutionTicks() - matrixStart;
+
+        auto toNanos = [&](juce::int64 ticks)
+        {
+            return juce::Time::highResolutionTicksToSeconds(ticks) * 1.0e9 / ((double) numBlocks * numSamples);
+        };
+
+        return juce::String("wet stage").paddedRight(' ', 24) + "per-channel ramps " + juce::String(toNanos(perChannelTicks), 3)
+            + " ns/sample, mid/side matrix " + juce::String(toNanos(matrixTicks), 3) + " ns/sample";
+    }
+}
+
+//==============================================================================
+static int runBenchmark(const juce::ArgumentList& args)
+{
+    BenchmarkSettings settings;
+    juce::String filter;
+
+    for (auto& arg : args.arguments)
+    {
+        if (arg.isLongOption("--state"))
+            juce::File::getCurrentWorkingDirectory().getChildFile(arg.getLongOptionValue()).loadFileAsData(settings.state);
+        else if (arg.isLongOption("--block"))
+            settings.blockSize = juce::jlimit(16, 8192, arg.getLongOptionValue().getIntValue());
+        else if (arg.isLongOption("--rate"))
+            settings.sampleRate = juce::jlimit(8000.0, 384000.0, arg.getLongOptionValue().getDoubleValue());
+        else if (arg.isLongOption("--seconds"))
+            settings.seconds = juce::jmax(0.1, arg.getLongOptionValue().getDoubleValue());
+        else if (arg.isLongOption("--scenario"))
+            filter = arg.getLongOptionValue();
+    }
+
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    std::cout << "block " << settings.blockSize << ", " << settings.sampleRate << " Hz, stereo" << std::endl;
+    std::map<juce::String, double> nanosPerScenario;
+    for (auto& scenario : getBenchmarkScenarios())
+    {
+        if (filter.isNotEmpty() && ! scenario.name.containsIgnoreCase(filter))
+            continue;
+
+        double nanosPerSample = 0.0;
+        std::cout << runScenario(scenario, settings, nanosPerSample) << std::endl;
+        nanosPerScenario[scenario.name] = nanosPerSample;
+    }
+
+    // cost of one scenario against another, zero when either of them was filtered out
+    auto getRatio = [&nanosPerScenario](const juce::String& name, const juce::String& reference)
+    {
+        const auto found = nanosPerScenario.find(name);
+        const auto referenceFound = nanosPerScenario.find(reference);
+        if (found == nanosPerScenario.end() || referenceFound == nanosPerScenario.end() || referenceFound->second <= 0.0)
+            return 0.0;
+        return found->second / referenceFound->second;
+    };
+
+    // reverse reads two windowed heads where forward reads one, it should stay within half as much again
+    const double reverseRatio = getRatio("reverse", "forward");
+    if (reverseRatio > 0.0)
+    {
+        const double maxReverseRatio = 1.5;
+        std::cout << juce::String("reverse / forward").paddedRight(' ', 24) << juce::String(reverseRatio, 2).paddedLeft(' ', 10)
+                  << (reverseRatio <= maxReverseRatio ? "   within " : "   over ") << maxReverseRatio << "x" << std::endl;
+    }
+
+    // what eco actually saves, measured against the same forward delay at the host rate
+    for (auto name : { "eco half", "eco quarter" })
+    {
+        const double ecoRatio = getRatio(name, "forward");
+        if (ecoRatio > 0.0)
+            std::cout << (juce::String(name) + " / forward").paddedRight(' ', 24) << juce::String(ecoRatio, 2).paddedLeft(' ', 10)
+                      << "   " << juce::roundToInt(100.0 * (1.0 - ecoRatio)) << "% of the CPU saved" << std::endl;
+    }
+
+    if (filter.isEmpty() || juce::String("wet stage").containsIgnoreCase(filter))
+        std::cout << runWetStageBenchmark(settings) << std::endl;
+
+    return 0;
+}
+
+static int runBatch(const juce::ArgumentList& args)
+{
+    RenderSettings settings;
+    juce::Array<juce::File> inputFiles;
+    juce::File stateFile;
+    int numThreads = juce::SystemStats::getNumCpus();
+    int numIoThreads = 1;
+
+    for (auto& arg : args.arguments)
+    {
+        if (arg.isLongOption("--state"))
+            stateFile = juce::File::getCurrentWorkingDirectory().getChildFile(arg.getLongOptionValue());
+        else if (arg.isLongOption("--out"))
+            settings.outputDir = juce::File::getCurrentWorkingDirectory().getChildFile(arg.getLongOptionValue());
+        else if (arg.isLongOption("--bpm"))
+            settings.bpm = juce::jlimit(20.0, 999.0, arg.getLongOptionValue().getDoubleValue());
+        else if (arg.isLongOption("--block"))
+            settings.blockSize = juce::jlimit(16, 8192, arg.getLongOptionValue().getIntValue());
+        else if (arg.isLongOption("--tail"))
+            settings.tailSeconds = juce::jmax(0.0, arg.getLongOptionValue().getDoubleValue());
+        else if (arg.isLongOption("--threads"))
+            numThreads = juce::jmax(1, arg.getLongOptionValue().getIntValue());
+        else if (arg.isLongOption("--io-threads"))
+            numIoThreads = juce::jmax(1, arg.getLongOptionValue().getIntValue());
+        else if (! arg.isOption())
+            inputFiles.add(arg.resolveAsFile());
+    }
+
+    if (! stateFile.existsAsFile() || settings.outputDir == juce::File() || inputFiles.isEmpty())
+    {
+        printUsage();
+        return 1;
+    }
+
+    if (! stateFile.loadFileAsData(settings.state))
+    {
+        std::cerr << "Could not read state from " << stateFile.getFullPathName() << std::endl;
+        return 1;
+    }
+    settings.outputDir.createDirectory();
+
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    // disk I/O threads are shared between the jobs, a couple of them keep up with many DSP threads
+    juce::OwnedArray<juce::TimeSliceThread> readThreads, writeThreads;
+    for (int i = 0; i < numIoThreads; ++i)
+    {
+        readThreads.add(new juce::TimeSliceThread("Read-ahead " + juce::String(i)))->startThread();
+        writeThreads.add(new juce::TimeSliceThread("Write-behind " + juce::String(i)))->startThread();
+    }
+
+    juce::OwnedArray<RenderResult> results;
+    const auto startTime = juce::Time::getMillisecondCounterHiRes();
+    {
+        juce::ThreadPool pool(numThreads);
+
+        // longest files first so one big file doesn't end up running on its own at the end
+        std::sort(inputFiles.begin(), inputFiles.end(),
+            [](const juce::File& a, const juce::File& b) { return a.getSize() > b.getSize(); });
+
+        for (int i = 0; i < inputFiles.size(); ++i)
+        {
+            auto* result = results.add(new RenderResult());
+            pool.addJob(new RenderJob(inputFiles[i], settings, *readThreads[i % numIoThreads],
+                *writeThreads[i % numIoThreads], *result), true);
+        }
+
+        while (pool.getNumJobs() > 0)
+            juce::Thread::sleep(20);
+    }
+    const auto wallSeconds = (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+
+    for (auto* t : readThreads)  t->stopThread(1000);
+    for (auto* t : writeThreads) t->stopThread(1000);
+
+    double totalAudioSeconds = 0.0, totalDspSeconds = 0.0;
+    int numFailed = 0;
+    for (auto* r : results)
+    {
+        std::cout << formatResult(*r) << std::endl;
+        totalAudioSeconds += r->audioSeconds;
+        totalDspSeconds += r->dspSeconds;
+        numFailed += r->succeeded ? 0 : 1;
+    }
+
+    std::cout << "----" << std::endl
+              << results.size() - numFailed << " of " << results.size() << " files rendered on "
+              << numThreads << " threads in " << juce::String(wallSeconds, 2) << " s" << std::endl
+              << "aggregate realtime x" << juce::String(totalAudioSeconds / juce::jmax(wallSeconds, 1.0e-9), 1)
+              << ", per core x" << juce::String(totalAudioSeconds / juce::jmax(wallSeconds * numThreads, 1.0e-9), 1)
+              << ", dsp only x" << juce::String(totalAudioSeconds / juce::jmax(totalDspSeconds, 1.0e-9), 1) << std::endl;
+
+    return numFailed == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+    juce::ArgumentList args(argc, argv);
+    const int result = args.containsOption("--bench") ? runBenchmark(args) : runBatch(args);
+
+    if (RealtimeSafetyChecker::isEnabled())
+    {
+        const int numViolations = RealtimeSafetyChecker::getNumViolations();
+        RealtimeSafetyChecker::report(std::cerr);
+        std::cout << "realtime check: " << numViolations << " allocations, locks or blocking calls inside processBlock" << std::endl;
+        if (numViolations > 0)
+            return 1;
+    }
+
+    return result;
+}
@@ -0,0 +1,157 @@
+/*
+  ==============================================================================
+
+    AllpassDiffuser.cpp
+
+  ==============================================================================
+*/
+
+#include "AllpassDiffuser.h"
+#include "VectorOps.h"
+
+namespace
+{
+    // mutually prime-ish lengths so the stages don't line up their echoes
+    constexpr float stageMilliseconds[AllpassDiffuser::maxStages] = { 4.77f, 3.59f, 12.73f, 9.31f, 7.13f, 15.87f, 5.51f, 11.03f };
+    constexpr float modulationMilliseconds = 0.35f;
+    constexpr double modulationHz = 0.6;
+
+   #if DIGITALDELAY_USE_SSE
+    // a stereo frame is the low two lanes of a register
+    using Lanes = __m128;
+    inline Lanes loadFrame(const float* p) noexcept              { return _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(p))); }
+    inline void storeFrame(float* p, Lanes v) noexcept          { _mm_store_sd(reinterpret_cast<double*>(p), _mm_castps_pd(v)); }
+    inline Lanes makeFrame(float l, float r) noexcept           { return _mm_setr_ps(l, r, 0.0f, 0.0f); }
+    inline Lanes splat(float v) noexcept                        { return _mm_set1_ps(v); }
+    inline Lanes add(Lanes a, Lanes b) noexcept                 { return _mm_add_ps(a, b); }
+    inline Lanes sub(Lanes a, Lanes b) noexcept                 { return _mm_sub_ps(a, b); }
+    inline Lanes mul(Lanes a, Lanes b) noexcept                 { return _mm_mul_ps(a, b); }
+    inline float left(Lanes v) noexcept                         { return _mm_cvtss_f32(v); }
+    inline float right(Lanes v) noexcept                        { return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))); }
+   #elif DIGITALDELAY_USE_NEON
+    using Lanes = float32x2_t;
+    inline Lanes loadFrame(const float* p) noexcept              { return vld1_f32(p); }
+    inline void storeFrame(float* p, Lanes v) noexcept          { vst1_f32(p, v); }
+    inline Lanes makeFrame(float l, float r) noexcept           { const float f[2] = { l, r }; return vld1_f32(f); }
+    inline Lanes splat(float v) noexcept                        { return vdup_n_f32(v); }
+    inline Lanes add(Lanes a, Lanes b) noexcept                 { return vadd_f32(a, b); }
+    inline Lanes sub(Lanes a, Lanes b) noexcept                 { return vsub_f32(a, b); }
+    inline Lanes mul(Lanes a, Lanes b) noexcept                 { return vmul_f32(a, b); }
+    inline float left(Lanes v) noexcept                         { return vget_lane_f32(v, 0); }
+    inline float right(Lanes v) noexcept                        { return vget_lane_f32(v, 1); }
+   #else
+    struct Lanes { float l, r; };
+    inline Lanes loadFrame(const float* p) noexcept              { return { p[0], p[1] }; }
+    inline void storeFrame(float* p, Lanes v) noexcept          { p[0] = v.l; p[1] = v.r; }
+    inline Lanes makeFrame(float l, float r) noexcept           { return { l, r }; }
+    inline Lanes splat(float v) noexcept                        { return { v, v }; }
+    inline Lanes add(Lanes a, Lanes b) noexcept                 { return { a.l + b.l, a.r + b.r }; }
+    inline Lanes sub(Lanes a, Lanes b) noexcept                 { return { a.l - b.l, a.r - b.r }; }
+    inline Lanes mul(Lanes a, Lanes b) noexcept                 { return { a.l * b.l, a.r * b.r }; }
+    inline float left(Lanes v) noexcept                         { return v.l; }
+    inline float right(Lanes v) noexcept                        { return v.r; }
+   #endif
+}
+
+void AllpassDiffuser::prepare(double maxSampleRate)
+{
+    // each stage gets a power of two line, two floats per frame, all in one block
+    const float maxDepth = modulationMilliseconds * 0.001f * (float) maxSampleRate;
+    size_t total = 0;
+    int sizes[maxStages];
+    for (int s = 0; s < maxStages; ++s)
+    {
+        const int longest = (int) std::ceil(stageMilliseconds[s] * 0.001f * (float) maxSampleRate + maxDepth) + 2;
+        sizes[s] = juce::nextPowerOfTwo(longest);
+        total += 2 * (size_t) sizes[s];
+    }
+
+    memory.allocate(total, true);
+    float* line = memory.get();
+    for (int s = 0; s < maxStages; ++s)
+    {
+        lines[s] = line;
+        masks[s] = sizes[s] - 1;
+        line += 2 * sizes[s];
+    }
+
+    setSampleRate(maxSampleRate);
+}
+
+void AllpassDiffuser::setSampleRate(double newSampleRate)
+{
+    sampleRate = newSampleRate;
+    depth = modulationMilliseconds * 0.001f * (float) sampleRate;
+    for (int s = 0; s < maxStages; ++s)
+    {
+        lengths[s] = (float) juce::roundToInt(stageMilliseconds[s] * 0.001f * sampleRate);
+        phases[s] = juce::MathConstants<double>::twoPi * s / maxStages;
+    }
+    phaseIncrement = juce::MathConstants<double>::twoPi * modulationHz * modulationChunk / sampleRate;
+    reset();
+}
+
+void AllpassDiffuser::setNumStages(int newNumStages) noexcept
+{
+    // a stage that was switched off still holds what it had then, which would otherwise play out again
+    newNumStages = juce::jlimit(1, maxStages, newNumStages);
+    for (int s = numStages; s < newNumStages; ++s)
+        if (lines[s] != nullptr)
+            juce::FloatVectorOperations::clear(lines[s], 2 * (masks[s] + 1));
+    numStages = newNumStages;
+}
+
+void AllpassDiffuser::reset()
+{
+    for (int s = 0; s < maxStages; ++s)
+        if (lines[s] != nullptr)
+            juce::FloatVectorOperations::clear(lines[s], 2 * (masks[s] + 1));
+    position = 0;
+}
+
+void AllpassDiffuser::process(float* leftChannel, float* rightChannel, int numSamples) noexcept
+{
+    const Lanes g = splat(gain);
+
+    for (int start = 0; start < numSamples; start += modulationChunk)
+    {
+        const int num = juce::jmin(modulationChunk, numSamples - start);
+
+        // the lengths move little enough over a chunk that they're only worked out once per chunk.
+        // Only the odd stages are modulated, the interpolation dulls the highs and the even ones stay whole
+        int delays[maxStages];
+        Lanes fractions[maxStages];
+        for (int s = 0; s < numStages; ++s)
+        {
+            const float length = (s % 2 == 0) ? lengths[s] : lengths[s] + depth * (float) std::sin(phases[s]);
+            delays[s] = (int) length;
+            fractions[s] = splat(length - (float) delays[s]);
+            phases[s] += phaseIncrement;
+            if (phases[s] > juce::MathConstants<double>::twoPi)
+                phases[s] -= juce::MathConstants<double>::twoPi;
+        }
+
+        for (int i = start; i < start + num; ++i)
+        {
+            Lanes x = makeFrame(leftChannel[i], rightChannel != nullptr ? rightChannel[i] : 0.0f);
+
+            for (int s = 0; s < numStages; ++s)
+            {
+                const int mask = masks[s];
+                float* line = lines[s];
+                const Lanes a = loadFrame(line + 2 * ((position - (unsigned int) delays[s]) & (unsigned int) mask));
+                const Lanes b = loadFrame(line + 2 * ((position - (unsigned int) delays[s] - 1) & (unsigned int) mask));
+                const Lanes delayed = add(a, mul(sub(b, a), fractions[s]));
+
+                const Lanes v = sub(x, mul(g, delayed));
+                storeFrame(line + 2 * (position & (unsigned int) mask), v);
+                x = add(delayed, mul(g, v));
+            }
+
+            leftChannel[i] = left(x);
+            if (rightChannel != nullptr)
+                rightChannel[i] = right(x);
+            ++position;
+        }
+    }
+}
@@ -0,0 +1,50 @@
+/*
+  ==============================================================================
+
+    AllpassDiffuser.h
+
+    Serial Schroeder allpasses with slowly modulated lengths, for smearing the
+    repeats into a cloud. Both channels run together as two lanes of one
+    vector, and every stage's line lives in one block of interleaved frames.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+class AllpassDiffuser
+{
+public:
+    static constexpr int maxStages = 8;
+
+    /** Allocates for the given rate, setSampleRate() can then go down to any lower rate without allocating. */
+    void prepare(double maxSampleRate);
+    void setSampleRate(double newSampleRate);
+    void reset();
+
+    /** Audio thread, between blocks. Stages that come back in start out silent. */
+    void setNumStages(int newNumStages) noexcept;
+    int getNumStages() const noexcept { return numStages; }
+    void setAmount(float newAmount) noexcept     { gain = 0.75f * juce::jlimit(0.0f, 1.0f, newAmount); }
+
+    /** right may be nullptr for mono. */
+    void process(float* left, float* right, int numSamples) noexcept;
+
+private:
+    static constexpr int modulationChunk = 32;
+
+    juce::HeapBlock<float> memory;
+    float* lines[maxStages]{};
+    int masks[maxStages]{};
+    float lengths[maxStages]{};   // in samples at the current rate
+    float depth{ 0.0f };
+    double phases[maxStages]{};
+    double phaseIncrement{ 0.0 };
+
+    double sampleRate{ 44100.0 };
+    int numStages{ 4 };
+    float gain{ 0.45f };
+    unsigned int position{ 0 };
+};
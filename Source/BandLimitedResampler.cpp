@@ -0,0 +1,61 @@
+/*
+  ==============================================================================
+
+    BandLimitedResampler.cpp
+
+  ==============================================================================
+*/
+
+#include "BandLimitedResampler.h"
+
+BandLimitedResampler::BandLimitedResampler()
+{
+    kernel.resize(halfTaps * tableResolution + 2);
+    for (size_t i = 0; i < kernel.size(); ++i)
+    {
+        const double x = (double) i / tableResolution;
+        if (x >= halfTaps)
+        {
+            kernel[i] = 0.0f;
+            continue;
+        }
+
+        const double sinc = (x == 0.0) ? 1.0 : std::sin(juce::MathConstants<double>::pi * x) / (juce::MathConstants<double>::pi * x);
+        const double w = 0.5 + 0.5 * (x / halfTaps);
+        const double blackman = 0.42 - 0.5 * std::cos(juce::MathConstants<double>::twoPi * w)
+                              + 0.08 * std::cos(2.0 * juce::MathConstants<double>::twoPi * w);
+        kernel[i] = (float) (sinc * blackman);
+    }
+}
+
+float BandLimitedResampler::getKernel(double x) const noexcept
+{
+    const double position = std::abs(x) * tableResolution;
+    const int index = (int) position;
+    if (index >= halfTaps * tableResolution)
+        return 0.0f;
+
+    const float frac = (float) (position - index);
+    return kernel[(size_t) index] + frac * (kernel[(size_t) index + 1] - kernel[(size_t) index]);
+}
+
+void BandLimitedResampler::process(const float* input, int numInput, float* output, int numOutput,
+    double firstPosition, double step) const
+{
+    // downsampling stretches the kernel so its cutoff sits at the output's Nyquist frequency
+    const double cutoff = juce::jmin(1.0, 1.0 / step);
+    const double reach = halfTaps / cutoff;
+
+    for (int j = 0; j < numOutput; ++j)
+    {
+        const double t = firstPosition + j * step;
+        const int first = juce::jmax(0, (int) std::ceil(t - reach));
+        const int last = juce::jmin(numInput - 1, (int) std::floor(t + reach));
+
+        double sum = 0.0;
+        for (int k = first; k <= last; ++k)
+            sum += input[k] * getKernel((t - k) * cutoff);
+
+        output[j] = (float) (sum * cutoff);
+    }
+}
@@ -0,0 +1,36 @@
+/*
+  ==============================================================================
+
+    BandLimitedResampler.h
+
+    Windowed sinc resampler for moving the delay line to a new sample rate.
+    It is meant for prepareToPlay, not for the audio callback.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+class BandLimitedResampler
+{
+public:
+    BandLimitedResampler();
+
+    /** Writes numOutput samples, output[j] being the input evaluated at
+        firstPosition + j * step (in input samples). When step > 1 the cutoff is
+        lowered to the new Nyquist frequency so nothing aliases.
+    */
+    void process(const float* input, int numInput, float* output, int numOutput,
+        double firstPosition, double step) const;
+
+private:
+    float getKernel(double x) const noexcept;
+
+    static constexpr int halfTaps = 16;
+    static constexpr int tableResolution = 256;
+
+    // Blackman windowed sinc over [0, halfTaps], symmetric so only one side is stored
+    std::vector<float> kernel;
+};
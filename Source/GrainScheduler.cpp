@@ -0,0 +1,157 @@
+/*
+  ==============================================================================
+
+    GrainScheduler.cpp
+
+  ==============================================================================
+*/
+
+#include "GrainScheduler.h"
+
+GrainScheduler::GrainScheduler(const WindowTable& windowToUse)
+    : window(windowToUse)
+{
+    reset();
+}
+
+void GrainScheduler::prepare(double newSampleRate)
+{
+    sampleRate = newSampleRate;
+    reset();
+}
+
+void GrainScheduler::reset()
+{
+    freeHead.store(endOfList);
+    numActive = 0;
+    for (int i = maxGrains; --i >= 0;)
+        pushFreeGrain(i);
+    samplesUntilNextGrain = 0.0;
+}
+
+int GrainScheduler::popFreeGrain() noexcept
+{
+    auto head = freeHead.load(std::memory_order_acquire);
+    for (;;)
+    {
+        const auto index = (juce::uint32) (head & endOfList);
+        if (index == endOfList)
+            return -1;
+
+        const juce::uint64 next = grains[index].nextFree.load(std::memory_order_relaxed);
+        const juce::uint64 newHead = (((head >> 32) + 1) << 32) | next;
+        if (freeHead.compare_exchange_weak(head, newHead, std::memory_order_acq_rel, std::memory_order_acquire))
+            return (int) index;
+    }
+}
+
+void GrainScheduler::pushFreeGrain(int index) noexcept
+{
+    auto head = freeHead.load(std::memory_order_acquire);
+    for (;;)
+    {
+        grains[index].nextFree.store((juce::uint32) (head & endOfList), std::memory_order_relaxed);
+        const juce::uint64 newHead = (((head >> 32) + 1) << 32) | (juce::uint32) index;
+        if (freeHead.compare_exchange_weak(head, newHead, std::memory_order_acq_rel, std::memory_order_acquire))
+            return;
+    }
+}
+
+void GrainScheduler::startGrain(int startOffset, int writePosition, int delaySamples, int delayLineSize,
+    int blockSize, const Settings& settings)
+{
+    const int index = popFreeGrain();
+    if (index < 0)
+        return; // pool exhausted, the grain is skipped rather than stealing one that is playing
+
+    auto& grain = grains[index];
+    const int length = juce::jmax(16, juce::roundToInt(settings.sizeMs * sampleRate / 1000.0));
+    const double pitch = juce::jlimit(0.25, 4.0, (double) settings.pitch);
+
+    // a grain playing faster than real time must not catch the write head,
+    // one playing slower must not fall off the far end of the delay line
+    const double jitterOffset = settings.jitter * random.nextFloat() * length;
+    const double minDistance = juce::jmax(0.0, (pitch - 1.0) * length) + 2.0;
+    const double maxDistance = delayLineSize - blockSize - juce::jmax(0.0, (1.0 - pitch) * length) - 2.0;
+    const double distance = juce::jlimit(minDistance, juce::jmax(minDistance, maxDistance), delaySamples + jitterOffset);
+
+    // short delays put the grain ahead of the write position, so wrap both ways
+    double readPos = writePosition + startOffset - distance;
+    while (readPos < 0.0)
+        readPos += delayLineSize;
+    while (readPos >= delayLineSize)
+        readPos -= delayLineSize;
+
+    grain.readPos = readPos;
+    grain.increment = pitch;
+    grain.windowPhase = 0.0;
+    grain.windowIncrement = 1.0 / length;
+    grain.startOffset = startOffset;
+    grain.remaining = length;
+
+    // overlapping grains are uncorrelated, so keep the summed power roughly constant
+    const float overlap = settings.density * settings.sizeMs / 1000.0f;
+    grain.gain = 1.0f / std::sqrt(juce::jmax(1.0f, overlap * 0.5f));
+
+    activeGrains[numActive++] = index;
+}
+
+void GrainScheduler::process(const juce::AudioBuffer<float>& delayLine, int writePosition, int delaySamples,
+    juce::AudioBuffer<float>& output, int numChannels, int numSamples, const Settings& settings)
+{
+    const int delayLineSize = delayLine.getNumSamples();
+    numChannels = juce::jmin(numChannels, delayLine.getNumChannels(), output.getNumChannels());
+    if (numChannels == 0)
+        return;
+
+    // schedule every grain that is due in this block at its sample offset
+    const double interval = sampleRate / juce::jmax(0.1f, settings.density);
+    while (samplesUntilNextGrain < numSamples)
+    {
+        startGrain((int) samplesUntilNextGrain, writePosition, delaySamples, delayLineSize, numSamples, settings);
+        samplesUntilNextGrain += interval * (1.0 + settings.jitter * (random.nextFloat() - 0.5f));
+    }
+    samplesUntilNextGrain -= numSamples;
+
+    const float* delayData[2] = { delayLine.getReadPointer(0), delayLine.getReadPointer(juce::jmin(1, numChannels - 1)) };
+    float* out[2] = { output.getWritePointer(0), output.getWritePointer(juce::jmin(1, numChannels - 1)) };
+
+    for (int g = 0; g < numActive;)
+    {
+        auto& grain = grains[activeGrains[g]];
+        const int num = juce::jmin(numSamples - grain.startOffset, grain.remaining);
+
+        for (int i = grain.startOffset; i < grain.startOffset + num; ++i)
+        {
+            const int index = (int) grain.readPos;
+            const int nextIndex = index + 1 < delayLineSize ? index + 1 : 0;
+            const float frac = (float) (grain.readPos - index);
+            const float gain = grain.gain * window(grain.windowPhase);
+
+            for (int c = 0; c < numChannels; ++c)
+            {
+                const float a = delayData[c][index];
+                out[c][i] += gain * (a + frac * (delayData[c][nextIndex] - a));
+            }
+
+            grain.readPos += grain.increment;
+            if (grain.readPos >= delayLineSize)
+                grain.readPos -= delayLineSize;
+            grain.windowPhase += grain.windowIncrement;
+        }
+
+        grain.remaining -= num;
+        grain.startOffset = 0;
+
+        // finished grains go back on the free list, the last active one takes their slot
+        if (grain.remaining <= 0)
+        {
+            pushFreeGrain(activeGrains[g]);
+            activeGrains[g] = activeGrains[--numActive];
+        }
+        else
+        {
+            ++g;
+        }
+    }
+}
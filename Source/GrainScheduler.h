@@ -0,0 +1,83 @@
+/*
+  ==============================================================================
+
+    GrainScheduler.h
+
+    Granular read kernel for the delay line: grains of the delayed signal at a
+    given size, density, pitch and position jitter.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "WindowTable.h"
+
+//==============================================================================
+/**
+    All grains live in a fixed pool. Free grains sit on a lock-free stack, so
+    starting and ending a grain never allocates or locks. Playing grains are
+    kept in a compact list, so the work per block is proportional to the number
+    of grains that are actually sounding.
+*/
+class GrainScheduler
+{
+public:
+    static constexpr int maxGrains = 64;
+
+    struct Settings
+    {
+        float sizeMs   { 80.0f };
+        float density  { 20.0f };   // grains per second
+        float pitch    { 1.0f };    // playback ratio
+        float jitter   { 0.2f };    // 0..1, random start offset in grain lengths
+    };
+
+    explicit GrainScheduler(const WindowTable& windowToUse);
+
+    void prepare(double sampleRate);
+    void reset();
+
+    /** Adds numSamples of grains into the first numChannels of output.
+        writePosition is where the current block starts in delayLine, new grains
+        start delaySamples behind it.
+    */
+    void process(const juce::AudioBuffer<float>& delayLine, int writePosition, int delaySamples,
+        juce::AudioBuffer<float>& output, int numChannels, int numSamples, const Settings& settings);
+
+    int getNumActiveGrains() const noexcept { return numActive; }
+
+private:
+    struct Grain
+    {
+        double readPos{ 0.0 };
+        double increment{ 1.0 };
+        double windowPhase{ 0.0 };
+        double windowIncrement{ 0.0 };
+        float  gain{ 1.0f };
+        int    startOffset{ 0 };
+        int    remaining{ 0 };
+        std::atomic<juce::uint32> nextFree{ 0 };
+    };
+
+    int  popFreeGrain() noexcept;
+    void pushFreeGrain(int index) noexcept;
+    void startGrain(int startOffset, int writePosition, int delaySamples, int delayLineSize,
+        int blockSize, const Settings& settings);
+
+    // the free list head packs an ABA tag into the top 32 bits and the grain index into the bottom
+    static constexpr juce::uint32 endOfList = 0xffffffff;
+    std::atomic<juce::uint64> freeHead{ endOfList };
+
+    Grain grains[maxGrains];
+    int   activeGrains[maxGrains];
+    int   numActive{ 0 };
+
+    const WindowTable& window;
+    juce::Random random;
+    double sampleRate{ 44100.0 };
+    double samplesUntilNextGrain{ 0.0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(GrainScheduler)
+};
@@ -0,0 +1,95 @@
+/*
+  ==============================================================================
+
+    HalfBandFilter.cpp
+
+  ==============================================================================
+*/
+
+#include "HalfBandFilter.h"
+#include "VectorOps.h"
+
+HalfBandFilter::HalfBandFilter()
+{
+    // Blackman windowed sinc with the cutoff at a quarter of the input rate, only the odd offsets from the centre
+    const int length = 2 * numBranchTaps - 1;
+    const int centreTap = numBranchTaps - 1;
+    float sum = 0.0f;
+    for (int i = 0; i < numBranchTaps; ++i)
+    {
+        const int n = 2 * i;
+        const double x = 0.5 * (n - centreTap);
+        const double sinc = std::sin(juce::MathConstants<double>::pi * x) / (juce::MathConstants<double>::pi * x);
+        const double w = (n + 1.0) / (length + 1.0);
+        const double blackman = 0.42 - 0.5 * std::cos(juce::MathConstants<double>::twoPi * w)
+                              + 0.08 * std::cos(2.0 * juce::MathConstants<double>::twoPi * w);
+        coefficients[i] = (float) (sinc * blackman);
+        sum += coefficients[i];
+    }
+
+    // the branch carries half the DC gain, the centre tap the other half
+    for (auto& c : coefficients)
+        c *= 0.5f / sum;
+
+    reset();
+}
+
+void HalfBandFilter::reset() noexcept
+{
+    std::fill(std::begin(history), std::end(history), 0.0f);
+    std::fill(std::begin(centre), std::end(centre), 0.0f);
+    historyPos = 0;
+    centrePos = 0;
+    evenPhase = true;
+}
+
+float HalfBandFilter::filterBranch(float x) noexcept
+{
+    history[historyPos] = x;
+    history[historyPos + numBranchTaps] = x;
+    if (++historyPos == numBranchTaps)
+        historyPos = 0;
+
+    // the coefficients are symmetric, so oldest-first lines up with them as well as newest-first
+    return VectorOps::dotProduct(history + historyPos, coefficients, numBranchTaps);
+}
+
+int HalfBandFilter::decimate(const float* input, int numInput, float* output) noexcept
+{
+    constexpr int centreDelay = numBranchTaps / 2;
+    int numOutput = 0;
+
+    for (int i = 0; i < numInput; ++i)
+    {
+        if (evenPhase)
+        {
+            // centre[centrePos] is the odd sample from centreDelay outputs ago
+            output[numOutput++] = filterBranch(input[i]) + 0.5f * centre[centrePos];
+        }
+        else
+        {
+            centre[centrePos] = input[i];
+            if (++centrePos == centreDelay)
+                centrePos = 0;
+        }
+        evenPhase = ! evenPhase;
+    }
+
+    return numOutput;
+}
+
+void HalfBandFilter::interpolate(const float* input, int numInput, float* output) noexcept
+{
+    constexpr int centreDelay = numBranchTaps / 2;
+
+    for (int i = 0; i < numInput; ++i)
+    {
+        const float x = input[i];
+        output[2 * i] = 2.0f * filterBranch(x);
+
+        centre[centrePos] = x;
+        if (++centrePos == centreDelay)
+            centrePos = 0;
+        output[2 * i + 1] = centre[centrePos];
+    }
+}
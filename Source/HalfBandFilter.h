@@ -0,0 +1,47 @@
+/*
+  ==============================================================================
+
+    HalfBandFilter.h
+
+    Polyphase half-band FIR for the eco mode, decimating or interpolating by two.
+    Every other tap of a half-band filter is zero, so one branch is a short FIR
+    and the other is just the centre tap, a plain delay.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+class HalfBandFilter
+{
+public:
+    HalfBandFilter();
+
+    void reset() noexcept;
+
+    /** Writes one output for every second input, starting with the first one after
+        reset(), and returns how many were written. The phase carries over between calls.
+    */
+    int decimate(const float* input, int numInput, float* output) noexcept;
+
+    /** Writes two outputs for every input. */
+    void interpolate(const float* input, int numInput, float* output) noexcept;
+
+    // the FIR branch, the full filter is 2 * numBranchTaps - 1 taps long
+    static constexpr int numBranchTaps = 24;
+
+private:
+    float filterBranch(float x) noexcept;
+
+    float coefficients[numBranchTaps];
+
+    // written twice so the newest numBranchTaps samples are always one contiguous run
+    float history[2 * numBranchTaps];
+    int historyPos{ 0 };
+
+    float centre[numBranchTaps / 2];
+    int centrePos{ 0 };
+    bool evenPhase{ true };
+};
@@ -20,8 +20,20 @@ DigitalDelayAudioProcessorEditor::DigitalDelayAudioProcessorEditor(DigitalDelayA
     feedbackSlider.setTooltip(juce::String("Change the feedback of the delay."));
     addAndMakeVisible(panSlider);
     panSlider.setTooltip(juce::String("Change the panning of the wet signal."));
+    addAndMakeVisible(widthSlider);
+    widthSlider.setTooltip(juce::String("Change the stereo width of the wet signal. 0% is mono, above 100% is wider than the input."));
     addAndMakeVisible(dryWetSlider);
     dryWetSlider.setTooltip(juce::String("Change the dry/wet blend."));
+    addAndMakeVisible(grainSizeSlider);
+    grainSizeSlider.setTooltip(juce::String("Change the length of each grain in granular mode."));
+    addAndMakeVisible(grainDensitySlider);
+    grainDensitySlider.setTooltip(juce::String("Change how many grains start every second in granular mode."));
+    addAndMakeVisible(grainPitchSlider);
+    grainPitchSlider.setTooltip(juce::String("Change the pitch of the grains in semitones. Use feedback for shimmer."));
+    addAndMakeVisible(grainJitterSlider);
+    grainJitterSlider.setTooltip(juce::String("Change how randomly the grains are scattered in time."));
+    addAndMakeVisible(crossfadeSlider);
+    crossfadeSlider.setTooltip(juce::String("Change how long the repeats take to fade over when the delay time changes."));
     createSliderAttachments();
 
     addAndMakeVisible(feedbackLabel);
@@ -34,22 +46,46 @@ DigitalDelayAudioProcessorEditor::DigitalDelayAudioProcessorEditor(DigitalDelayA
     panLabel.setJustificationType(juce::Justification::horizontallyCentred);
     panLabel.setFont(juce::Font(12.0f));
 
+    addAndMakeVisible(widthLabel);
+    widthLabel.setText(juce::String("Width"), juce::NotificationType::dontSendNotification);
+    widthLabel.setJustificationType(juce::Justification::horizontallyCentred);
+    widthLabel.setFont(juce::Font(12.0f));
+
     addAndMakeVisible(dryWetLabel);
     dryWetLabel.setText(juce::String("Dry/Wet"), juce::NotificationType::dontSendNotification);
     dryWetLabel.setJustificationType(juce::Justification::horizontallyCentred);
     dryWetLabel.setFont(juce::Font(12.0f));
     
+    addAndMakeVisible(grainSizeLabel);
+    grainSizeLabel.setText(juce::String("Grain Size"), juce::NotificationType::dontSendNotification);
+    grainSizeLabel.setJustificationType(juce::Justification::horizontallyCentred);
+    grainSizeLabel.setFont(juce::Font(12.0f));
+
+    addAndMakeVisible(grainDensityLabel);
+    grainDensityLabel.setText(juce::String("Density"), juce::NotificationType::dontSendNotification);
+    grainDensityLabel.setJustificationType(juce::Justification::horizontallyCentred);
+    grainDensityLabel.setFont(juce::Font(12.0f));
+
+    addAndMakeVisible(grainPitchLabel);
+    grainPitchLabel.setText(juce::String("Pitch"), juce::NotificationType::dontSendNotification);
+    grainPitchLabel.setJustificationType(juce::Justification::horizontallyCentred);
+    grainPitchLabel.setFont(juce::Font(12.0f));
+
+    addAndMakeVisible(grainJitterLabel);
+    grainJitterLabel.setText(juce::String("Jitter"), juce::NotificationType::dontSendNotification);
+    grainJitterLabel.setJustificationType(juce::Justification::horizontallyCentred);
+    grainJitterLabel.setFont(juce::Font(12.0f));
+
+    addAndMakeVisible(crossfadeLabel);
+    crossfadeLabel.setText(juce::String("Crossfade"), juce::NotificationType::dontSendNotification);
+    crossfadeLabel.setJustificationType(juce::Justification::horizontallyCentred);
+    crossfadeLabel.setFont(juce::Font(12.0f));
+    
     addAndMakeVisible(millisecondsButton);
-    //Only want to be able to toggle a button on if it is currently off, implement further in buttonClicked()
-    millisecondsButton.setClickingTogglesState(!audioProcessor.isMillisecondsActive());
-    //Setting the toggle states according to flags in the processor to ensure they are correct upon construction
-    millisecondsButton.setToggleState(audioProcessor.isMillisecondsActive(), juce::NotificationType::dontSendNotification);
     millisecondsButton.addListener(this);
     millisecondsButton.setTooltip(juce::String("Set delay time in milliseconds."));
 
     addAndMakeVisible(stepsButton);
-    stepsButton.setClickingTogglesState(!audioProcessor.isStepsActive());
-    stepsButton.setToggleState(audioProcessor.isStepsActive(), juce::NotificationType::dontSendNotification);
     stepsButton.addListener(this);
     stepsButton.setTooltip(juce::String("Set delay time in tempo synced steps."));
 
@@ -63,14 +99,10 @@ DigitalDelayAudioProcessorEditor::DigitalDelayAudioProcessorEditor(DigitalDelayA
     stepsLabel.setFont(juce::Font(12.0f));
 
     addAndMakeVisible(sixteenthNoteButton);
-    sixteenthNoteButton.setClickingTogglesState(!audioProcessor.isSixteenthNoteActive());
-    sixteenthNoteButton.setToggleState(audioProcessor.isSixteenthNoteActive(), juce::NotificationType::dontSendNotification);
     sixteenthNoteButton.addListener(this);
     sixteenthNoteButton.setTooltip(juce::String("Set delay time in sixteenth note steps. Disabled if time is being set in milliseconds."));
 
     addAndMakeVisible(eighthTripletButton);
-    eighthTripletButton.setClickingTogglesState(!audioProcessor.isEighthTripletActive());
-    eighthTripletButton.setToggleState(audioProcessor.isEighthTripletActive(), juce::NotificationType::dontSendNotification);
     eighthTripletButton.addListener(this);
     eighthTripletButton.setTooltip(juce::String("Set delay time in eighth note tripled steps. Disabled if time is being set in milliseconds."));
 
@@ -85,6 +117,69 @@ DigitalDelayAudioProcessorEditor::DigitalDelayAudioProcessorEditor(DigitalDelayA
     eighthTripletLabel.setJustificationType(juce::Justification::centredLeft);
     eighthTripletLabel.setFont(juce::Font(12.0f));
 
+    addAndMakeVisible(freezeButton);
+    freezeButton.setTooltip(juce::String("Hold the current repeats as an endless loop. Nothing new is recorded until it is released."));
+    buttonAttachments.add(new juce::AudioProcessorValueTreeState::ButtonAttachment
+    (audioProcessor.tree, audioProcessor.getFreezeParamName(), freezeButton));
+
+    addAndMakeVisible(freezeLabel);
+    freezeLabel.setText(juce::String("Freeze"), juce::NotificationType::dontSendNotification);
+    freezeLabel.setJustificationType(juce::Justification::centredLeft);
+    freezeLabel.setFont(juce::Font(12.0f));
+
+    addAndMakeVisible(reverseButton);
+    reverseButton.setTooltip(juce::String("Play the repeats backwards, one delay time long segment at a time."));
+    buttonAttachments.add(new juce::AudioProcessorValueTreeState::ButtonAttachment
+    (audioProcessor.tree, audioProcessor.getReverseParamName(), reverseButton));
+
+    addAndMakeVisible(reverseLabel);
+    reverseLabel.setText(juce::String("Reverse"), juce::NotificationType::dontSendNotification);
+    reverseLabel.setJustificationType(juce::Justification::centredLeft);
+    reverseLabel.setFont(juce::Font(12.0f));
+
+    addAndMakeVisible(granularButton);
+    granularButton.setTooltip(juce::String("Play the repeats as a cloud of grains."));
+    buttonAttachments.add(new juce::AudioProcessorValueTreeState::ButtonAttachment
+    (audioProcessor.tree, audioProcessor.getGranularParamName(), granularButton));
+
+    addAndMakeVisible(granularLabel);
+    granularLabel.setText(juce::String("Granular"), juce::NotificationType::dontSendNotification);
+    granularLabel.setJustificationType(juce::Justification::centredLeft);
+    granularLabel.setFont(juce::Font(12.0f));
+
+    addAndMakeVisible(spectralButton);
+    spectralButton.setTooltip(juce::String("Delay each band of frequencies on its own. Adds latency of one FFT size. Freeze, reverse and granular wait while it is on."));
+    buttonAttachments.add(new juce::AudioProcessorValueTreeState::ButtonAttachment
+    (audioProcessor.tree, audioProcessor.getSpectralParamName(), spectralButton));
+
+    addAndMakeVisible(spectralLabel);
+    spectralLabel.setText(juce::String("Spectral"), juce::NotificationType::dontSendNotification);
+    spectralLabel.setJustificationType(juce::Justification::centredLeft);
+    spectralLabel.setFont(juce::Font(12.0f));
+
+    // the items have to be there before the attachment picks one
+    addAndMakeVisible(ecoBox);
+    ecoBox.addItemList(juce::StringArray{ "Off", "Half", "Quarter" }, 1);
+    ecoBox.setTooltip(juce::String("Run the repeats at a half or a quarter of the sample rate to save CPU. They get darker and the delay line is cleared when this changes."));
+    ecoAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ComboBoxAttachment>
+    (audioProcessor.tree, audioProcessor.getEcoParamName(), ecoBox);
+
+    addAndMakeVisible(ecoLabel);
+    ecoLabel.setText(juce::String("Eco"), juce::NotificationType::dontSendNotification);
+    ecoLabel.setJustificationType(juce::Justification::horizontallyCentred);
+    ecoLabel.setFont(juce::Font(12.0f));
+
+    addAndMakeVisible(diffusionBox);
+    diffusionBox.addItemList(juce::StringArray{ "Off", "Wet", "Feedback" }, 1);
+    diffusionBox.setTooltip(juce::String("Smear the repeats into a cloud. On the wet signal every repeat is smeared the same, in the feedback each repeat gets denser than the last."));
+    diffusionAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ComboBoxAttachment>
+    (audioProcessor.tree, audioProcessor.getDiffusionParamName(), diffusionBox);
+
+    addAndMakeVisible(diffusionLabel);
+    diffusionLabel.setText(juce::String("Diffusion"), juce::NotificationType::dontSendNotification);
+    diffusionLabel.setJustificationType(juce::Justification::horizontallyCentred);
+    diffusionLabel.setFont(juce::Font(12.0f));
+
     addAndMakeVisible(increaseButton);
     increaseButton.addListener(this); 
     increaseButton.setRepeatSpeed(500, 15, -1);
@@ -102,13 +197,23 @@ DigitalDelayAudioProcessorEditor::DigitalDelayAudioProcessorEditor(DigitalDelayA
     editorFont.setTypefaceName("Courier new");
     editorFont.setSizeAndStyle(56, "Arial", 1, 0);
     display.setFont(editorFont);
-    if (audioProcessor.isStepsActive())
-        display.setText(juce::String(audioProcessor.steps));
-    else
-        display.setText(juce::String(audioProcessor.msec));
     display.onReturnKey = [this]() { setTimeValFromText(); };
 
-    setSize (650, 150);
+    addAndMakeVisible(captureButton);
+    captureButton.setButtonText(juce::String("Print wet"));
+    captureButton.setToggleState(audioProcessor.getWetCapture().isCapturing(), juce::NotificationType::dontSendNotification);
+    captureButton.addListener(this);
+    captureButton.setTooltip(juce::String("Record the wet signal only to a file in your music folder."));
+
+    addAndMakeVisible(captureLabel);
+    captureLabel.setJustificationType(juce::Justification::centredLeft);
+    captureLabel.setFont(juce::Font(12.0f));
+
+    // the time controls follow the processor's snapshot, set them all up from it once
+    refreshTimeControls(true);
+    startTimerHz(30);
+
+    setSize (740, 250);
 }
 
 DigitalDelayAudioProcessorEditor::~DigitalDelayAudioProcessorEditor()
@@ -138,8 +243,36 @@ void DigitalDelayAudioProcessorEditor::resized()
     panSlider.setBounds(470, 45, sliderSide, sliderSide);
     panLabel.setBounds(470, 135, sliderSide, 12);
 
-    dryWetSlider.setBounds(560, 45, sliderSide, sliderSide);
-    dryWetLabel.setBounds(560, 135, sliderSide, 12);
+    widthSlider.setBounds(560, 45, sliderSide, sliderSide);
+    widthLabel.setBounds(560, 135, sliderSide, 12);
+
+    dryWetSlider.setBounds(650, 45, sliderSide, sliderSide);
+    dryWetLabel.setBounds(650, 135, sliderSide, 12);
+
+    crossfadeSlider.setBounds(10, 145, sliderSide, sliderSide);
+    crossfadeLabel.setBounds(10, 235, sliderSide, 12);
+
+    ecoBox.setBounds(110, 180, 90, 24);
+    ecoLabel.setBounds(110, 162, 90, 12);
+    diffusionBox.setBounds(110, 222, 90, 24);
+    diffusionLabel.setBounds(110, 208, 90, 12);
+
+    granularButton.setBounds(buttonStartX, 175, buttonSide, buttonSide);
+    granularLabel.setBounds(granularButton.getX() + granularButton.getWidth() / 2 + 5, granularButton.getY() + granularButton.getWidth() / 3, 60, 12);
+    spectralButton.setBounds(buttonStartX, 207, buttonSide, buttonSide);
+    spectralLabel.setBounds(spectralButton.getX() + spectralButton.getWidth() / 2 + 5, spectralButton.getY() + spectralButton.getWidth() / 3, 60, 12);
+
+    grainSizeSlider.setBounds(290, 145, sliderSide, sliderSide);
+    grainSizeLabel.setBounds(290, 235, sliderSide, 12);
+
+    grainDensitySlider.setBounds(380, 145, sliderSide, sliderSide);
+    grainDensityLabel.setBounds(380, 235, sliderSide, 12);
+
+    grainPitchSlider.setBounds(470, 145, sliderSide, sliderSide);
+    grainPitchLabel.setBounds(470, 235, sliderSide, 12);
+
+    grainJitterSlider.setBounds(560, 145, sliderSide, sliderSide);
+    grainJitterLabel.setBounds(560, 235, sliderSide, 12);
 
     millisecondsButton.setBounds(buttonStartX, buttonStartY, buttonSide, buttonSide);
     millisecondsLabel.setBounds(millisecondsButton.getX() + millisecondsButton.getWidth() / 2 + 5, millisecondsButton.getY() + millisecondsButton.getWidth() / 3, 30, 12);
@@ -156,6 +289,13 @@ void DigitalDelayAudioProcessorEditor::resized()
     display.setBounds(10, millisecondsButton.getY(), 130, 60);
     increaseButton.setBounds(display.getRight() + 10, display.getY(), 24, 24);
     decreaseButton.setBounds(display.getRight() + 10, display.getBottom() - 24, 24, 24);
+
+    captureButton.setBounds(10, 10, 80, 24);
+    freezeButton.setBounds(380, 6, buttonSide, buttonSide);
+    freezeLabel.setBounds(freezeButton.getX() + freezeButton.getWidth() / 2 + 5, freezeButton.getY() + freezeButton.getWidth() / 3, 60, 12);
+    reverseButton.setBounds(470, 6, buttonSide, buttonSide);
+    reverseLabel.setBounds(reverseButton.getX() + reverseButton.getWidth() / 2 + 5, reverseButton.getY() + reverseButton.getWidth() / 3, 60, 12);
+    captureLabel.setBounds(captureButton.getRight() + 10, captureButton.getY(), 270, 24);
 }
 
 void DigitalDelayAudioProcessorEditor::createSliderAttachments()
@@ -165,7 +305,19 @@ void DigitalDelayAudioProcessorEditor::createSliderAttachments()
     sliderAttachments.add(new juce::AudioProcessorValueTreeState::SliderAttachment
     (audioProcessor.tree, audioProcessor.getPanParamName(), panSlider));
     sliderAttachments.add(new juce::AudioProcessorValueTreeState::SliderAttachment
+    (audioProcessor.tree, audioProcessor.getWidthParamName(), widthSlider));
+    sliderAttachments.add(new juce::AudioProcessorValueTreeState::SliderAttachment
     (audioProcessor.tree, audioProcessor.getDryWetParamName(), dryWetSlider));
+    sliderAttachments.add(new juce::AudioProcessorValueTreeState::SliderAttachment
+    (audioProcessor.tree, audioProcessor.getGrainSizeParamName(), grainSizeSlider));
+    sliderAttachments.add(new juce::AudioProcessorValueTreeState::SliderAttachment
+    (audioProcessor.tree, audioProcessor.getGrainDensityParamName(), grainDensitySlider));
+    sliderAttachments.add(new juce::AudioProcessorValueTreeState::SliderAttachment
+    (audioProcessor.tree, audioProcessor.getGrainPitchParamName(), grainPitchSlider));
+    sliderAttachments.add(new juce::AudioProcessorValueTreeState::SliderAttachment
+    (audioProcessor.tree, audioProcessor.getGrainJitterParamName(), grainJitterSlider));
+    sliderAttachments.add(new juce::AudioProcessorValueTreeState::SliderAttachment
+    (audioProcessor.tree, audioProcessor.getCrossfadeParamName(), crossfadeSlider));
 }
 void DigitalDelayAudioProcessorEditor::createButtonAttachments()
 {
@@ -181,127 +333,130 @@ void DigitalDelayAudioProcessorEditor::createButtonAttachments()
 
 void DigitalDelayAudioProcessorEditor::setTimeValFromText()
 {
-    int newVal = display.getText().getIntValue();
-    if (audioProcessor.isStepsActive())
-    { 
-        if (newVal < 1)
-            audioProcessor.steps = 1;
-        else if (newVal > 16)
-            audioProcessor.steps = 16;
-        else
-            audioProcessor.steps = newVal;
-        display.setText(juce::String(audioProcessor.steps));
+    const int maximum = shownTimeState.millisecondsActive ? DigitalDelayAudioProcessor::maxMilliseconds
+                                                          : DigitalDelayAudioProcessor::maxSteps;
+    const int newVal = juce::jlimit(1, maximum, display.getText().getIntValue());
+    if (pushTimeCommand(DigitalDelayAudioProcessor::TimeCommand::setValue, newVal))
+        display.setText(juce::String(newVal));
+}
+
+bool DigitalDelayAudioProcessorEditor::pushTimeCommand(DigitalDelayAudioProcessor::TimeCommand command, int value)
+{
+    if (audioProcessor.pushTimeCommand(command, value))
+        return true;
+
+    // the queue is full, so the controls go back to what the processor actually has
+    refreshTimeControls(true);
+    return false;
+}
+
+void DigitalDelayAudioProcessorEditor::refreshTimeControls(bool force)
+{
+    const auto version = audioProcessor.getTimeStateVersion();
+    if (! force && version == shownTimeStateVersion)
+        return;
+
+    const auto state = audioProcessor.getTimeState();
+    const auto& shown = shownTimeState;
+    shownTimeStateVersion = version;
+
+    // only the controls that changed are touched, so nothing repaints while the time stands still
+    const bool modeChanged = force || state.millisecondsActive != shown.millisecondsActive;
+    if (modeChanged)
+    {
+        // a button can only be toggled on while it is off, the processor turns the other one off
+        millisecondsButton.setClickingTogglesState(! state.millisecondsActive);
+        millisecondsButton.setToggleState(state.millisecondsActive, juce::NotificationType::dontSendNotification);
+        stepsButton.setClickingTogglesState(state.millisecondsActive);
+        stepsButton.setToggleState(! state.millisecondsActive, juce::NotificationType::dontSendNotification);
+        sixteenthNoteButton.setEnabled(! state.millisecondsActive);
+        eighthTripletButton.setEnabled(! state.millisecondsActive);
     }
+
+    if (force || state.eighthTripletActive != shown.eighthTripletActive)
+    {
+        sixteenthNoteButton.setClickingTogglesState(state.eighthTripletActive);
+        sixteenthNoteButton.setToggleState(! state.eighthTripletActive, juce::NotificationType::dontSendNotification);
+        eighthTripletButton.setClickingTogglesState(! state.eighthTripletActive);
+        eighthTripletButton.setToggleState(state.eighthTripletActive, juce::NotificationType::dontSendNotification);
+    }
+
+    const int value = state.millisecondsActive ? state.msec : state.steps;
+    const int shownValue = shown.millisecondsActive ? shown.msec : shown.steps;
+    if (modeChanged || value != shownValue)
+        display.setText(juce::String(value));
+
+    shownTimeState = state;
+}
+
+void DigitalDelayAudioProcessorEditor::toggleWetCapture()
+{
+    auto& capture = audioProcessor.getWetCapture();
+    if (capture.isCapturing())
+        capture.stop();
     else
-    { 
-        if (newVal < 1)
-            audioProcessor.msec = 1;
-        else if (newVal > 2000)
-            audioProcessor.msec = 2000;
-        else
-            audioProcessor.msec = newVal;
-        display.setText(juce::String(audioProcessor.msec));
+        capture.start(juce::File::getSpecialLocation(juce::File::userMusicDirectory)
+            .getChildFile("DigitalDelay").getNonexistentChildFile("WetCapture", ".wav"));
+
+    captureButton.setToggleState(capture.isCapturing(), juce::NotificationType::dontSendNotification);
+    timerCallback();
+}
+
+void DigitalDelayAudioProcessorEditor::timerCallback()
+{
+    refreshTimeControls(false);
+
+    // the spectral engine doesn't read the delay line, so the read modes have nothing to act on while it runs
+    const bool readModesEnabled = ! spectralButton.getToggleState();
+    for (auto* component : std::initializer_list<juce::Component*>{ &freezeButton, &freezeLabel,
+             &reverseButton, &reverseLabel, &granularButton, &granularLabel })
+        component->setEnabled(readModesEnabled);
+
+    auto& capture = audioProcessor.getWetCapture();
+    if (! capture.isCapturing())
+    {
+        captureLabel.setText({}, juce::NotificationType::dontSendNotification);
+        return;
     }
+
+    const double sampleRate = juce::jmax(1.0, audioProcessor.getSampleRate());
+    auto text = capture.getFile().getFileName() + "  " + juce::String(capture.getNumCapturedSamples() / sampleRate, 1) + " s";
+    if (capture.getNumDroppedSamples() > 0)
+        text << ", dropped " << juce::String(capture.getNumDroppedSamples()) << " samples";
+    captureLabel.setText(text, juce::NotificationType::dontSendNotification);
 }
 
 void DigitalDelayAudioProcessorEditor::buttonClicked(juce::Button* b)
 {
-    DBG("button clicked");
-    if (b == &millisecondsButton && !audioProcessor.isMillisecondsActive())
+    // the processor picks these up at the start of its next block, the controls follow on the next timer tick
+    using TimeCommand = DigitalDelayAudioProcessor::TimeCommand;
+
+    if (b == &millisecondsButton && ! shownTimeState.millisecondsActive)
     {
-        millisecondsButton.setClickingTogglesState(false);
-        audioProcessor.convertStepsToMsec();
-        audioProcessor.setStepsActive(false);
-        audioProcessor.setMillisecondsActive(true);
-        display.setText(juce::String(audioProcessor.msec));
-
-        stepsButton.setClickingTogglesState(true);
-        stepsButton.setToggleState(false, juce::NotificationType::dontSendNotification);
-
-        eighthTripletButton.setEnabled(false);
-        sixteenthNoteButton.setEnabled(false);
-
-        if (audioProcessor.isMillisecondsActive())
-            DBG("msec after active from buttonclicked->b==millisecondsButton");
-        else
-            DBG("msec after inactive from buttonclicked->b==millisecondsButton");
-        if (audioProcessor.isStepsActive())
-            DBG("steps after active from buttonclicked->b==millisecondsButton");
-        else
-            DBG("steps after inactive from buttonclicked->b==millisecondsButton");
+        pushTimeCommand(TimeCommand::useMilliseconds);
     }
-    else if (b == &stepsButton && !audioProcessor.isStepsActive())
+    else if (b == &stepsButton && shownTimeState.millisecondsActive)
     {
-        stepsButton.setClickingTogglesState(false);
-        audioProcessor.convertStepsToMsec();
-        audioProcessor.setStepsActive(true);
-        audioProcessor.setMillisecondsActive(false);
-        display.setText(juce::String(audioProcessor.steps));
-        
-        millisecondsButton.setClickingTogglesState(true);
-        millisecondsButton.setToggleState(false, juce::NotificationType::dontSendNotification);
-
-        eighthTripletButton.setEnabled(true);
-        sixteenthNoteButton.setEnabled(true);
-
-        if (audioProcessor.isMillisecondsActive())
-            DBG("msec after active from buttonclicked->b==stepsButton");
-        else
-            DBG("msec after inactive from buttonclicked->b==stepsButton");
-        if (audioProcessor.isStepsActive())
-            DBG("steps after active from buttonclicked->b==stepsButton");
-        else
-            DBG("steps after inactive from buttonclicked->b==stepsButton");
+        pushTimeCommand(TimeCommand::useSteps);
     }
-    else if (b == &sixteenthNoteButton && !audioProcessor.isSixteenthNoteActive())
+    else if (b == &sixteenthNoteButton && shownTimeState.eighthTripletActive)
     {
-        DBG("16th change editor");
-        audioProcessor.setSixteenthNoteActive(true);
-        audioProcessor.convertStepsToMsec();
-        sixteenthNoteButton.setClickingTogglesState(false);
-
-        audioProcessor.setEighthTripletActive(false);
-        eighthTripletButton.setClickingTogglesState(true);
-        eighthTripletButton.setToggleState(false, juce::NotificationType::dontSendNotification);
+        pushTimeCommand(TimeCommand::useSixteenthNotes);
     }
-    else if (b == &eighthTripletButton && !audioProcessor.isEighthTripletActive())
+    else if (b == &eighthTripletButton && ! shownTimeState.eighthTripletActive)
     {
-        DBG("18 changed editor");
-        audioProcessor.setEighthTripletActive(true);
-        audioProcessor.convertStepsToMsec();
-        eighthTripletButton.setClickingTogglesState(false);
-
-        audioProcessor.setSixteenthNoteActive(false);
-        sixteenthNoteButton.setClickingTogglesState(true);
-        sixteenthNoteButton.setToggleState(false, juce::NotificationType::dontSendNotification);
+        pushTimeCommand(TimeCommand::useEighthTriplets);
     }
     else if (b == &increaseButton)
     {
-        if (audioProcessor.isStepsActive() && audioProcessor.steps >= 1 && audioProcessor.steps < 16)
-        {
-            ++audioProcessor.steps;
-            audioProcessor.convertStepsToMsec();
-            display.setText(juce::String(audioProcessor.steps));
-        }
-        else if (audioProcessor.isMillisecondsActive() && audioProcessor.msec >= 1 && audioProcessor.msec < 2000)
-        {
-            ++audioProcessor.msec;
-            display.setText(juce::String(audioProcessor.msec));
-        }
-        
+        pushTimeCommand(TimeCommand::nudgeValue, 1);
     }
     else if (b == &decreaseButton)
     {
-        if (audioProcessor.isStepsActive() && audioProcessor.steps > 1 && audioProcessor.steps <= 16)
-        {
-            --audioProcessor.steps;
-            audioProcessor.convertStepsToMsec();
-            display.setText(juce::String(audioProcessor.steps));
-        }
-        else if (audioProcessor.isMillisecondsActive() && audioProcessor.msec > 1 && audioProcessor.msec <= 2000)
-        {
-            --audioProcessor.msec;
-            display.setText(juce::String(audioProcessor.msec));
-        }
+        pushTimeCommand(TimeCommand::nudgeValue, -1);
+    }
+    else if (b == &captureButton)
+    {
+        toggleWetCapture();
     }
 }
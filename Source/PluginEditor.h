@@ -14,7 +14,8 @@
 //==============================================================================
 /**
 */
-class DigitalDelayAudioProcessorEditor  : public juce::AudioProcessorEditor, public juce::Button::Listener 
+class DigitalDelayAudioProcessorEditor  : public juce::AudioProcessorEditor, public juce::Button::Listener,
+                                          private juce::Timer
 {
 public:
     DigitalDelayAudioProcessorEditor (DigitalDelayAudioProcessor&);
@@ -29,29 +30,60 @@ public:
     void createButtonAttachments(); 
     void buttonClicked(juce::Button* ) override;
     void setTimeValFromText();
+    bool pushTimeCommand(DigitalDelayAudioProcessor::TimeCommand command, int value = 0);
+    void toggleWetCapture();
+    void refreshTimeControls(bool force);
 
 private:
     juce::Slider            feedbackSlider { juce::Slider::RotaryHorizontalVerticalDrag, juce::Slider::TextBoxBelow };
     juce::Slider                 panSlider { juce::Slider::RotaryHorizontalVerticalDrag, juce::Slider::TextBoxBelow };
+    juce::Slider               widthSlider { juce::Slider::RotaryHorizontalVerticalDrag, juce::Slider::TextBoxBelow };
     juce::Slider              dryWetSlider { juce::Slider::RotaryHorizontalVerticalDrag, juce::Slider::TextBoxBelow };
+    juce::Slider           grainSizeSlider { juce::Slider::RotaryHorizontalVerticalDrag, juce::Slider::TextBoxBelow };
+    juce::Slider        grainDensitySlider { juce::Slider::RotaryHorizontalVerticalDrag, juce::Slider::TextBoxBelow };
+    juce::Slider          grainPitchSlider { juce::Slider::RotaryHorizontalVerticalDrag, juce::Slider::TextBoxBelow };
+    juce::Slider         grainJitterSlider { juce::Slider::RotaryHorizontalVerticalDrag, juce::Slider::TextBoxBelow };
+    juce::Slider           crossfadeSlider { juce::Slider::RotaryHorizontalVerticalDrag, juce::Slider::TextBoxBelow };
     juce::ArrowButton       increaseButton;
     juce::ArrowButton       decreaseButton;
     juce::ToggleButton  millisecondsButton;
     juce::ToggleButton         stepsButton;
     juce::ToggleButton sixteenthNoteButton;
     juce::ToggleButton eighthTripletButton;
+    juce::ToggleButton        freezeButton;
+    juce::ToggleButton       reverseButton;
+    juce::ToggleButton      granularButton;
+    juce::ToggleButton      spectralButton;
     juce::TextEditor               display;
+    juce::TextButton         captureButton;
+    juce::ComboBox                ecoBox;
+    juce::ComboBox          diffusionBox;
 
     juce::Label              feedbackLabel;
     juce::Label                   panLabel;
+    juce::Label                 widthLabel;
     juce::Label                dryWetLabel;
     juce::Label          millisecondsLabel;
     juce::Label                 stepsLabel;
     juce::Label         sixteenthNoteLabel;
     juce::Label         eighthTripletLabel;
+    juce::Label                freezeLabel;
+    juce::Label               reverseLabel;
+    juce::Label              granularLabel;
+    juce::Label              spectralLabel;
+    juce::Label             grainSizeLabel;
+    juce::Label          grainDensityLabel;
+    juce::Label            grainPitchLabel;
+    juce::Label           grainJitterLabel;
+    juce::Label             crossfadeLabel;
+    juce::Label               captureLabel;
+    juce::Label                   ecoLabel;
+    juce::Label             diffusionLabel;
 
     juce::OwnedArray<juce::AudioProcessorValueTreeState::SliderAttachment> sliderAttachments;
     juce::OwnedArray<juce::AudioProcessorValueTreeState::ButtonAttachment> buttonAttachments;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> ecoAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> diffusionAttachment;
 
     juce::SharedResourcePointer<juce::TooltipWindow> tooltipWindow; 
     
@@ -60,5 +92,11 @@ private:
     int testValSteps;
     int testValMs;
 
+    // what the time controls show, only redrawn when the processor's version moves on
+    DigitalDelayAudioProcessor::TimeState shownTimeState;
+    juce::uint32 shownTimeStateVersion{ 0 };
+
+    void timerCallback() override;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DigitalDelayAudioProcessorEditor)
 };
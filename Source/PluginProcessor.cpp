@@ -8,6 +8,8 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "VectorOps.h"
+#include "RealtimeSafetyChecker.h"
 
 //==============================================================================
 DigitalDelayAudioProcessor::DigitalDelayAudioProcessor()
@@ -27,17 +29,37 @@ DigitalDelayAudioProcessor::DigitalDelayAudioProcessor()
 {
     tree.addParameterListener(getFeedbackParamName(), this);
     tree.addParameterListener(getPanParamName(), this);
+    tree.addParameterListener(getWidthParamName(), this);
     tree.addParameterListener(getDryWetParamName(), this);
+    tree.addParameterListener(getFreezeParamName(), this);
+    tree.addParameterListener(getReverseParamName(), this);
+    tree.addParameterListener(getGranularParamName(), this);
+    tree.addParameterListener(getGrainSizeParamName(), this);
+    tree.addParameterListener(getGrainDensityParamName(), this);
+    tree.addParameterListener(getGrainPitchParamName(), this);
+    tree.addParameterListener(getGrainJitterParamName(), this);
+    tree.addParameterListener(getCrossfadeParamName(), this);
+    tree.addParameterListener(getBypassFeedsDelayParamName(), this);
+    tree.addParameterListener(getEcoParamName(), this);
+    tree.addParameterListener(getSpectralParamName(), this);
+    tree.addParameterListener(getSpectralSizeParamName(), this);
+    tree.addParameterListener(getSpectralTiltParamName(), this);
+    tree.addParameterListener(getSpectralDampingParamName(), this);
+    tree.addParameterListener(getDiffusionParamName(), this);
+    tree.addParameterListener(getDiffusionStagesParamName(), this);
+    tree.addParameterListener(getDiffusionAmountParamName(), this);
     delayBuffer.clear();
     dryBuffer.clear();
     convertStepsToMsec();
+    publishTimeState();
+    startTimerHz(20);
 
     buttonIDs = { juce::String("Milliseconds"), juce::String("Steps"), juce::String("EighthTriplet"), juce::String("Sixteenth") };
 }
 
 DigitalDelayAudioProcessor::~DigitalDelayAudioProcessor()
 {
-    
+    stopTimer();
 }
 
 juce::AudioProcessorValueTreeState::ParameterLayout DigitalDelayAudioProcessor::createParameterLayout()
@@ -45,6 +67,15 @@ juce::AudioProcessorValueTreeState::ParameterLayout DigitalDelayAudioProcessor::
     juce::NormalisableRange<float> feedbackRange (0.0f, 1.0f);
     juce::NormalisableRange<float> dryWetRange   (0.0f, 1.0f);
     juce::NormalisableRange<float> panRange      (-1.0f, 1.0f);
+    juce::NormalisableRange<float> widthRange    (0.0f, 2.0f);
+    juce::NormalisableRange<float> crossfadeRange    (1.0f, 250.0f, 0.1f, 0.5f);
+    juce::NormalisableRange<float> grainSizeRange    (10.0f, 1000.0f, 1.0f, 0.5f);
+    juce::NormalisableRange<float> grainDensityRange (1.0f, 500.0f, 0.1f, 0.4f);
+    juce::NormalisableRange<float> grainPitchRange   (-24.0f, 24.0f, 1.0f);
+    juce::NormalisableRange<float> grainJitterRange  (0.0f, 1.0f);
+    juce::NormalisableRange<float> spectralTiltRange    (-1.0f, 1.0f);
+    juce::NormalisableRange<float> spectralDampingRange (0.0f, 1.0f);
+    juce::NormalisableRange<float> diffusionAmountRange (0.0f, 1.0f);
 
     std::vector <std::unique_ptr<juce::RangedAudioParameter>> params;
 
@@ -67,13 +98,96 @@ juce::AudioProcessorValueTreeState::ParameterLayout DigitalDelayAudioProcessor::
                          : juce::String(-100 * param,1) + "% L"; });
     params.push_back(std::move(panParam));
 
+    auto widthParam    = std::make_unique<juce::AudioParameterFloat>(getWidthParamName(),
+                         getWidthParamName(), widthRange, 1.0f,
+                         juce::String(), juce::AudioProcessorParameter::genericParameter,
+                         [](float param, int) {return juce::String(param * 100, 1) + "%"; });
+    params.push_back(std::move(widthParam));
+
+    auto freezeParam   = std::make_unique<juce::AudioParameterBool>(getFreezeParamName(),
+                         getFreezeParamName(), false);
+    params.push_back(std::move(freezeParam));
+
+    auto reverseParam  = std::make_unique<juce::AudioParameterBool>(getReverseParamName(),
+                         getReverseParamName(), false);
+    params.push_back(std::move(reverseParam));
+
+    auto granularParam = std::make_unique<juce::AudioParameterBool>(getGranularParamName(),
+                         getGranularParamName(), false);
+    params.push_back(std::move(granularParam));
+
+    auto grainSizeParam    = std::make_unique<juce::AudioParameterFloat>(getGrainSizeParamName(),
+                             getGrainSizeParamName(), grainSizeRange, 80.0f,
+                             juce::String(), juce::AudioProcessorParameter::genericParameter,
+                             [](float param, int) {return juce::String(param, 0) + " ms"; });
+    params.push_back(std::move(grainSizeParam));
+
+    auto grainDensityParam = std::make_unique<juce::AudioParameterFloat>(getGrainDensityParamName(),
+                             getGrainDensityParamName(), grainDensityRange, 20.0f,
+                             juce::String(), juce::AudioProcessorParameter::genericParameter,
+                             [](float param, int) {return juce::String(param, 1) + " /s"; });
+    params.push_back(std::move(grainDensityParam));
+
+    auto grainPitchParam   = std::make_unique<juce::AudioParameterFloat>(getGrainPitchParamName(),
+                             getGrainPitchParamName(), grainPitchRange, 0.0f,
+                             juce::String(), juce::AudioProcessorParameter::genericParameter,
+                             [](float param, int) {return (param > 0 ? "+" : "") + juce::String(param, 0) + " st"; });
+    params.push_back(std::move(grainPitchParam));
+
+    auto grainJitterParam  = std::make_unique<juce::AudioParameterFloat>(getGrainJitterParamName(),
+                             getGrainJitterParamName(), grainJitterRange, 0.2f,
+                             juce::String(), juce::AudioProcessorParameter::genericParameter,
+                             [](float param, int) {return juce::String(param * 100, 1) + "%"; });
+    params.push_back(std::move(grainJitterParam));
+
+    auto crossfadeParam    = std::make_unique<juce::AudioParameterFloat>(getCrossfadeParamName(),
+                             getCrossfadeParamName(), crossfadeRange, 20.0f,
+                             juce::String(), juce::AudioProcessorParameter::genericParameter,
+                             [](float param, int) {return juce::String(param, 1) + " ms"; });
+    params.push_back(std::move(crossfadeParam));
+
+    auto bypassFeedsDelayParam = std::make_unique<juce::AudioParameterBool>(getBypassFeedsDelayParamName(),
+                                 getBypassFeedsDelayParamName(), false);
+    params.push_back(std::move(bypassFeedsDelayParam));
+
+    auto ecoParam = std::make_unique<juce::AudioParameterChoice>(getEcoParamName(),
+                    getEcoParamName(), juce::StringArray{ "Off", "Half", "Quarter" }, 0);
+    params.push_back(std::move(ecoParam));
+
+    auto spectralParam        = std::make_unique<juce::AudioParameterBool>(getSpectralParamName(),
+                                getSpectralParamName(), false);
+    params.push_back(std::move(spectralParam));
+
+    auto spectralSizeParam    = std::make_unique<juce::AudioParameterChoice>(getSpectralSizeParamName(),
+                                getSpectralSizeParamName(), juce::StringArray{ "512", "1024", "2048" }, 1);
+    params.push_back(std::move(spectralSizeParam));
+
+    auto spectralTiltParam    = std::make_unique<juce::AudioParameterFloat>(getSpectralTiltParamName(),
+                                getSpectralTiltParamName(), spectralTiltRange, 0.0f);
+    params.push_back(std::move(spectralTiltParam));
+
+    auto spectralDampingParam = std::make_unique<juce::AudioParameterFloat>(getSpectralDampingParamName(),
+                                getSpectralDampingParamName(), spectralDampingRange, 0.3f);
+    params.push_back(std::move(spectralDampingParam));
+
+    auto diffusionParam       = std::make_unique<juce::AudioParameterChoice>(getDiffusionParamName(),
+                                getDiffusionParamName(), juce::StringArray{ "Off", "Wet", "Feedback" }, 0);
+    params.push_back(std::move(diffusionParam));
+
+    auto diffusionStagesParam = std::make_unique<juce::AudioParameterInt>(getDiffusionStagesParamName(),
+                                getDiffusionStagesParamName(), 1, AllpassDiffuser::maxStages, 4);
+    params.push_back(std::move(diffusionStagesParam));
+
+    auto diffusionAmountParam = std::make_unique<juce::AudioParameterFloat>(getDiffusionAmountParamName(),
+                                getDiffusionAmountParamName(), diffusionAmountRange, 0.6f);
+    params.push_back(std::move(diffusionAmountParam));
+
     return { params.begin(), params.end() };
 
 }
 
 void DigitalDelayAudioProcessor::parameterChanged(const juce::String& parameter, float newValue)
 {
-    DBG("param changed");
     bool boolVal = static_cast<bool> (newValue);
     if (parameter == getFeedbackParamName())
     {
@@ -86,8 +200,82 @@ void DigitalDelayAudioProcessor::parameterChanged(const juce::String& parameter,
     }
     else if (parameter == getPanParamName())
     {
-        panGains[0] = newValue <= 0 ? 1.0f : std::sqrt(1.0f - newValue); //left gain
-        panGains[1] = newValue >= 0 ? 1.0f : std::sqrt(1.0f + newValue);
+        pan = newValue;
+    }
+    else if (parameter == getWidthParamName())
+    {
+        width = newValue;
+    }
+    else if (parameter == getFreezeParamName())
+    {
+        freezeRequested = boolVal;
+    }
+    else if (parameter == getReverseParamName())
+    {
+        reverseRequested = boolVal;
+    }
+    else if (parameter == getGranularParamName())
+    {
+        granularRequested = boolVal;
+    }
+    else if (parameter == getGrainSizeParamName())
+    {
+        grainSettings.sizeMs = newValue;
+    }
+    else if (parameter == getGrainDensityParamName())
+    {
+        grainSettings.density = newValue;
+    }
+    else if (parameter == getGrainPitchParamName())
+    {
+        grainSettings.pitch = std::pow(2.0f, newValue / 12.0f);
+    }
+    else if (parameter == getGrainJitterParamName())
+    {
+        grainSettings.jitter = newValue;
+    }
+    else if (parameter == getCrossfadeParamName())
+    {
+        readHeads.setFadeLength(newValue / 1000.0);
+    }
+    else if (parameter == getBypassFeedsDelayParamName())
+    {
+        bypassFeedsDelay = boolVal;
+    }
+    else if (parameter == getEcoParamName())
+    {
+        ecoRequested = 1 << juce::jlimit(0, maxEcoStages, juce::roundToInt(newValue));
+    }
+    else if (parameter == getSpectralParamName())
+    {
+        spectralRequested = boolVal;
+        pendingLatency = spectralRequested ? 1 << spectralOrderRequested : 0;
+    }
+    else if (parameter == getSpectralSizeParamName())
+    {
+        spectralOrderRequested = SpectralDelay::minOrder + juce::roundToInt(newValue);
+        pendingLatency = spectralRequested ? 1 << spectralOrderRequested : 0;
+    }
+    else if (parameter == getSpectralTiltParamName())
+    {
+        spectralSettings.tilt = newValue;
+    }
+    else if (parameter == getSpectralDampingParamName())
+    {
+        spectralSettings.damping = newValue;
+    }
+    else if (parameter == getDiffusionParamName())
+    {
+        diffusionPlacement = static_cast<DiffusionPlacement>(juce::jlimit(0, 2, juce::roundToInt(newValue)));
+    }
+    else if (parameter == getDiffusionStagesParamName())
+    {
+        diffusionStagesRequested = juce::roundToInt(newValue);
+    }
+    else if (parameter == getDiffusionAmountParamName())
+    {
+        diffuser.setAmount(newValue);
+        spectralDiffuser.setAmount(newValue);
     }
     else if (parameter == getMsecParamName())
     {
@@ -223,12 +411,145 @@ void DigitalDelayAudioProcessor::changeProgramName (int index, const juce::Strin
 //==============================================================================
 void DigitalDelayAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    lastSampleRate = sampleRate;
+    // nothing is processing, so a state restored before playback is in place before the first block
+    applyTimeCommands();
+
     const int numInputChannels = getTotalNumInputChannels();
-    const int delayBufferSize = 2 * (sampleRate + samplesPerBlock); //2 seconds max delay and 2 buffers
-    delayBuffer.setSize(numInputChannels, delayBufferSize);
-    dryBuffer.setSize(numInputChannels, samplesPerBlock);
-    expectedReadPos = -1;
+    fullRateDelayBufferSize = 2 * (juce::roundToInt(sampleRate) + samplesPerBlock); //2 seconds max delay and 2 buffers
+
+    // in eco mode the delay line runs at a fraction of the host rate and is that much shorter
+    ecoFactor = ecoRequested;
+    ecoFadingOut = false;
+    const double newDelaySampleRate = sampleRate / ecoFactor;
+    resizeDelayBuffer(numInputChannels, fullRateDelayBufferSize / ecoFactor, delaySampleRate, newDelaySampleRate);
+    lastSampleRate = sampleRate;
+    delaySampleRate = newDelaySampleRate;
+
+    // leave room for the full rate ring so switching eco off later doesn't allocate on the audio thread
+    reserveDelayBuffer(numInputChannels, fullRateDelayBufferSize);
+
+    const int maxDecimatedSamples = samplesPerBlock / 2 + 2;
+    ecoBuffer.setSize(numInputChannels, maxDecimatedSamples, false, false, true);
+    ecoDryBuffer.setSize(numInputChannels, maxDecimatedSamples, false, false, true);
+    ecoStageBuffer.setSize(numInputChannels, maxDecimatedSamples + 2, false, false, true);
+    ecoWetBuffer.setSize(numInputChannels, samplesPerBlock + (1 << maxEcoStages), false, false, true);
+    resetEcoFilters();
+
+    // the scratch buffers keep their allocation when the block size shrinks
+    dryBuffer.setSize(numInputChannels, samplesPerBlock, false, false, true);
+    frozen = false;
+    loopFadePos = 0;
+    readMode = ReadMode::forward;
+    kernelBuffer.setSize(numInputChannels, samplesPerBlock, false, false, true);
+    reverseWindow.setSize(1, juce::jmax(fullRateDelayBufferSize, delayBuffer.getNumSamples()) / 2, false, false, true);
+    reverseWindowLength = 0;
+    grainScheduler.prepare(delaySampleRate);
+    wetBuffer.setSize(getTotalNumOutputChannels(), samplesPerBlock, false, false, true);
+    wetCapture.prepare(getTotalNumOutputChannels(), sampleRate);
+    readHeads.prepare(delaySampleRate);
+    lastWetMatrix = getWetMatrix();
+    bypassed = false;
+    midiTime = 0;
+    numClockTicks = 0;
+    lastTapTime = -1;
+
+    diffuser.prepare(sampleRate);
+    diffuser.setSampleRate(delaySampleRate);
+    diffusionBuffer.setSize(numInputChannels, samplesPerBlock, false, false, true);
+
+    spectralDelay.setOrder(spectralOrderRequested);
+    spectralDelay.prepare(numInputChannels, sampleRate);
+    spectralActive = false;
+    spectralScratch.setSize(numInputChannels, samplesPerBlock, false, false, true);
+    spectralScratchWet.setSize(numInputChannels, samplesPerBlock, false, false, true);
+    spectralDryBuffer.setSize(numInputChannels, samplesPerBlock, false, false, true);
+    spectralWetBuffer.setSize(numInputChannels, samplesPerBlock, false, false, true);
+    spectralDiffuser.prepare(sampleRate);
+    pendingLatency = spectralRequested ? spectralDelay.getLatencySamples() : 0;
+    setLatencySamples(pendingLatency);
+
+    // long enough for the largest FFT size, so a size change never has to allocate
+    latencyBuffer.setSize(numInputChannels, 1 << SpectralDelay::maxOrder, false, true, true);
+    latencyWritePosition = 0;
+    dryLatency = 0;
+}
+
+void DigitalDelayAudioProcessor::timerCallback()
+{
+    const int latency = pendingLatency.load();
+    if (latency != getLatencySamples())
+        setLatencySamples(latency);
+}
+
+void DigitalDelayAudioProcessor::resizeDelayBuffer(int numChannels, int minimumSize, double oldSampleRate, double newSampleRate)
+{
+    const int oldSize = delayBuffer.getNumSamples();
+    const bool rateChanged = oldSize > 0 && std::abs(newSampleRate - oldSampleRate) > 0.5;
+
+    // same rate and enough room: the ring and writePosition stay as they are
+    if (! rateChanged && delayBuffer.getNumChannels() == numChannels && oldSize >= minimumSize)
+        return;
+
+    if (oldSize == 0)
+    {
+        delayBuffer.setSize(numChannels, minimumSize);
+        delayBufferReservedChannels = numChannels;
+        delayBufferReservedSamples = minimumSize;
+        writePosition = 0;
+        return;
+    }
+
+    // unwrap the ring in place so the oldest sample is first and the newest is last
+    for (int channel = 0; channel < delayBuffer.getNumChannels(); ++channel)
+    {
+        float* data = delayBuffer.getWritePointer(channel);
+        std::rotate(data, data + writePosition, data + oldSize);
+    }
+
+    if (! rateChanged)
+    {
+        // growing keeps the old samples at the start, the cleared space behind them reads as silence
+        const int newSize = juce::jmax(oldSize, minimumSize);
+        delayBuffer.setSize(numChannels, newSize, true, true, true);
+        if (numChannels != delayBufferReservedChannels || newSize > delayBufferReservedSamples)
+        {
+            delayBufferReservedChannels = numChannels;
+            delayBufferReservedSamples = newSize;
+        }
+        writePosition = oldSize % newSize;
+        return;
+    }
+
+    // resample the newest part of the tail that fits, ending on the most recent input sample
+    const double step = oldSampleRate / newSampleRate;
+    const int numToKeep = juce::jmin(minimumSize, (int) (oldSize / step));
+    const double firstPosition = (oldSize - 1) - (numToKeep - 1) * step;
+
+    resampleBuffer.setSize(numChannels, minimumSize, false, false, true);
+    resampleBuffer.clear();
+    for (int channel = 0; channel < juce::jmin(numChannels, delayBuffer.getNumChannels()); ++channel)
+        tailResampler.process(delayBuffer.getReadPointer(channel), oldSize,
+            resampleBuffer.getWritePointer(channel), numToKeep, firstPosition, step);
+
+    // the old allocation becomes the scratch buffer for the next rate change. All that is known of the
+    // one taken over is that it fits this size
+    std::swap(delayBuffer, resampleBuffer);
+    delayBufferReservedChannels = numChannels;
+    delayBufferReservedSamples = minimumSize;
+    writePosition = numToKeep % minimumSize;
+}
+
+void DigitalDelayAudioProcessor::reserveDelayBuffer(int numChannels, int numSamples)
+{
+    if (numChannels == delayBufferReservedChannels && numSamples <= delayBufferReservedSamples)
+        return;
+
+    // growing copies the ring into a new block, shrinking back then keeps that block
+    const int delayBufferSize = delayBuffer.getNumSamples();
+    delayBuffer.setSize(numChannels, juce::jmax(numSamples, delayBufferSize), true, true, false);
+    delayBuffer.setSize(numChannels, delayBufferSize, true, false, true);
+    delayBufferReservedChannels = numChannels;
+    delayBufferReservedSamples = juce::jmax(numSamples, delayBufferSize);
 }
 
 void DigitalDelayAudioProcessor::releaseResources()
@@ -265,244 +586,1443 @@ bool DigitalDelayAudioProcessor::isBusesLayoutSupported (const BusesLayout& layo
 
 void DigitalDelayAudioProcessor::processBlock(juce::AudioSampleBuffer& buffer, juce::MidiBuffer& midiMessages)
 {
-    playHead = this->getPlayHead();
-    playHead->getCurrentPosition(sessionInfo);
-    tempo = sessionInfo.bpm;
-    convertStepsToMsec();
+    RealtimeSafetyChecker::ScopedAudioThread audioThread;
 
-    if (Bus* inputBus = getBus(true, 0))
+    // decaying feedback and diffuser tails would otherwise end up as denormals
+    juce::ScopedNoDenormals noDenormals;
+    applyTimeCommands();
+
+    // a steady spectral engine doesn't read the delay line, so there's nothing to hear when it is cleared
+    updateEcoFactor(! (spectralActive && spectralRequested));
+    updateDiffusionStages();
+
+    if (! bypassed)
     {
-        const float gain = dryGain;
-        const float wetGain[2] = { dryWet * panGains[0],dryWet * panGains[1] };
-        const float time = msec;
-        const float feedback = this->feedback;
+        delayDryByLatency(buffer, false);
+        processWithMidi(buffer, midiMessages);
+        return;
+    }
 
-        // write original to delay
-        for (int i = 0; i < delayBuffer.getNumChannels(); ++i)
-        {
-            const int inputChannelNum = inputBus->getChannelIndexInProcessBlockBuffer(std::min(i, inputBus->getNumberOfChannels()));
-            writeToDelayBuffer(buffer, inputChannelNum, i, writePosition, 1.0f, 1.0f, true);
-        }
+    // first block after a bypass: the delay fades in from the dry signal over the block
+    bypassed = false;
+    readHeads.reset();
+    dryBuffer.makeCopyOf(buffer, true);
+    delayDryByLatency(dryBuffer, true);
+    processWithMidi(buffer, midiMessages);
 
-        // adapt dry gain
-        buffer.applyGainRamp(0, buffer.getNumSamples(), lastDryGain, gain);
-        lastDryGain = gain;
+    for (int i = 0; i < buffer.getNumChannels(); ++i)
+    {
+        buffer.applyGainRamp(i, 0, buffer.getNumSamples(), 0.0f, 1.0f);
+        buffer.addFromWithRamp(i, 0, dryBuffer.getReadPointer(i), buffer.getNumSamples(), 1.0f, 0.0f);
+    }
+}
 
-        // read delayed signal
-        auto readPos = juce::roundToInt(writePosition - (lastSampleRate * time / 1000.0));
-        if (readPos < 0)
-            readPos += delayBuffer.getNumSamples();
+void DigitalDelayAudioProcessor::processBlockBypassed(juce::AudioSampleBuffer& buffer, juce::MidiBuffer& midiMessages)
+{
+    RealtimeSafetyChecker::ScopedAudioThread audioThread;
+    juce::ScopedNoDenormals noDenormals;
+    applyTimeCommands();
 
-        if (Bus* outputBus = getBus(false, 0))
-        {
-            // if has run before
-            if (expectedReadPos >= 0)
-            {
-                // fade out if readPos is off
-                
-                for (int i = 0; i < outputBus->getNumberOfChannels(); ++i)
-                {
-                    auto endGain = (readPos == expectedReadPos) ? wetGain[i] : 0.0f;
-                    const int outputChannelNum = outputBus->getChannelIndexInProcessBlockBuffer(i);
-                    readFromDelayBuffer(buffer, i, outputChannelNum, expectedReadPos, wetGain[i], endGain, false);
-                }
-            }
+    // only the first bypassed block, which fades out to the dry signal, still has wet in it
+    updateEcoFactor(! bypassed);
+    updateDiffusionStages();
 
-            // fade in at new position
-            if (readPos != expectedReadPos)
-            {
-                for (int i = 0; i < outputBus->getNumberOfChannels(); ++i)
-                {
-                    const int outputChannelNum = outputBus->getChannelIndexInProcessBlockBuffer(i);
-                    readFromDelayBuffer(buffer, i, outputChannelNum, readPos, 0.0, wetGain[i], false);
-                }
-            }
-        }
+    if (bypassed)
+    {
+        // the clock and taps are still followed, the delay line just keeps being written
+        for (const auto metadata : midiMessages)
+            handleMidiEvent(metadata.getMessage(), midiTime + metadata.samplePosition);
+        midiTime += buffer.getNumSamples();
 
-        // add feedback to delay
-        for (int i = 0; i < inputBus->getNumberOfChannels(); ++i)
-        {
-            const int outputChannelNum = inputBus->getChannelIndexInProcessBlockBuffer(i);
-            writeToDelayBuffer(buffer, outputChannelNum, i, writePosition, lastFeedback, feedback, false);
-        }
-        lastFeedback = feedback;
+        writeAtDelayRate(buffer, bypassFeedsDelay);
+        delayDryByLatency(buffer, true);
+        return;
+    }
 
-        // advance positions
-        writePosition += buffer.getNumSamples();
-        if (writePosition >= delayBuffer.getNumSamples())
-            writePosition -= delayBuffer.getNumSamples();
+    // first bypassed block: the delay still runs once and fades out to the dry signal
+    bypassed = true;
+    dryBuffer.makeCopyOf(buffer, true);
+    delayDryByLatency(dryBuffer, true);
+    processWithMidi(buffer, midiMessages);
 
-        expectedReadPos = readPos + buffer.getNumSamples();
-        if (expectedReadPos >= delayBuffer.getNumSamples())
-            expectedReadPos -= delayBuffer.getNumSamples();
+    for (int i = 0; i < buffer.getNumChannels(); ++i)
+    {
+        buffer.applyGainRamp(i, 0, buffer.getNumSamples(), 1.0f, 0.0f);
+        buffer.addFromWithRamp(i, 0, dryBuffer.getReadPointer(i), buffer.getNumSamples(), 0.0f, 1.0f);
     }
 }
 
-void DigitalDelayAudioProcessor::writeToDelayBuffer(juce::AudioSampleBuffer& buffer,
-    const int channelIn, const int channelOut,
-    const int writePos, float startGain, float endGain, bool replacing)
+void DigitalDelayAudioProcessor::delayDryByLatency(juce::AudioSampleBuffer& buffer, bool replaceWithDelayed)
 {
-    if (writePos + buffer.getNumSamples() <= delayBuffer.getNumSamples())
+    // the ring only runs while there is latency, it starts out silent rather than with whatever it held last time
+    const int latency = pendingLatency.load();
+    if (latency > 0 && dryLatency == 0)
     {
-        if (replacing)
-            delayBuffer.copyFromWithRamp(channelOut, writePos, buffer.getReadPointer(channelIn), buffer.getNumSamples(), startGain, endGain);
-        else
-            delayBuffer.addFromWithRamp(channelOut, writePos, buffer.getReadPointer(channelIn), buffer.getNumSamples(), startGain, endGain);
+        latencyBuffer.clear();
+        latencyWritePosition = 0;
     }
-    else
+    dryLatency = latency;
+    if (latency == 0)
+        return;
+
+    // each sample is read before its slot is written, so a ring as long as the latency is enough
+    const int mask = latencyBuffer.getNumSamples() - 1;
+    const int numSamples = buffer.getNumSamples();
+    for (int c = 0; c < juce::jmin(buffer.getNumChannels(), latencyBuffer.getNumChannels()); ++c)
     {
-        const auto midPos = delayBuffer.getNumSamples() - writePos;
-        const auto midGain = juce::jmap(float(midPos) / buffer.getNumSamples(), startGain, endGain);
-        if (replacing)
-        {
-            delayBuffer.copyFromWithRamp(channelOut, writePos, buffer.getReadPointer(channelIn), midPos, startGain, midGain);
-            delayBuffer.copyFromWithRamp(channelOut, 0, buffer.getReadPointer(channelIn, midPos), buffer.getNumSamples() - midPos, midGain, endGain);
-        }
-        else
+        float* ring = latencyBuffer.getWritePointer(c);
+        float* data = buffer.getWritePointer(c);
+        for (int i = 0; i < numSamples; ++i)
         {
-            delayBuffer.addFromWithRamp(channelOut, writePos, buffer.getReadPointer(channelIn), midPos, lastDryGain, midGain);
-            delayBuffer.addFromWithRamp(channelOut, 0, buffer.getReadPointer(channelIn, midPos), buffer.getNumSamples() - midPos, midGain, endGain);
+            const float input = data[i];
+            if (replaceWithDelayed)
+                data[i] = ring[(latencyWritePosition + i - latency) & mask];
+            ring[(latencyWritePosition + i) & mask] = input;
         }
     }
+
+    latencyWritePosition = (latencyWritePosition + numSamples) & mask;
 }
 
-void DigitalDelayAudioProcessor::readFromDelayBuffer(juce::AudioSampleBuffer& buffer,
-    const int channelIn, const int channelOut,
-    const int readPos,
-    float startGain, float endGain,
-    bool replacing)
+void DigitalDelayAudioProcessor::writeBypassedToDelayBuffer(const juce::AudioSampleBuffer& buffer, bool feedInput)
 {
-    if (readPos + buffer.getNumSamples() <= delayBuffer.getNumSamples())
-    {
-        if (replacing)
-            buffer.copyFromWithRamp(channelOut, 0, delayBuffer.getReadPointer(channelIn, readPos), buffer.getNumSamples(), startGain, endGain);
-        else
-            buffer.addFromWithRamp(channelOut, 0, delayBuffer.getReadPointer(channelIn, readPos), buffer.getNumSamples(), startGain, endGain);
-    }
-    else
+    // a frozen loop stays as it is until the plugin comes back
+    if (frozen)
+        return;
+
+    // write only, nothing is read or mixed and the output is left dry
+    const int numSamples = buffer.getNumSamples();
+    const int delayBufferSize = delayBuffer.getNumSamples();
+    const int firstPart = juce::jmin(numSamples, delayBufferSize - writePosition);
+
+    for (int i = 0; i < delayBuffer.getNumChannels(); ++i)
     {
-        const auto midPos = delayBuffer.getNumSamples() - readPos;
-        const auto midGain = juce::jmap(float(midPos) / buffer.getNumSamples(), startGain, endGain);
-        if (replacing)
+        if (feedInput && i < buffer.getNumChannels())
         {
-            buffer.copyFromWithRamp(channelOut, 0, delayBuffer.getReadPointer(channelIn, readPos), midPos, startGain, midGain);
-            buffer.copyFromWithRamp(channelOut, midPos, delayBuffer.getReadPointer(channelIn), buffer.getNumSamples() - midPos, midGain, endGain);
+            delayBuffer.copyFrom(i, writePosition, buffer, i, 0, firstPart);
+            delayBuffer.copyFrom(i, 0, buffer, i, firstPart, numSamples - firstPart);
         }
         else
         {
-            buffer.addFromWithRamp(channelOut, 0, delayBuffer.getReadPointer(channelIn, readPos), midPos, startGain, midGain);
-            buffer.addFromWithRamp(channelOut, midPos, delayBuffer.getReadPointer(channelIn), buffer.getNumSamples() - midPos, midGain, endGain);
+            delayBuffer.clear(i, writePosition, firstPart);
+            delayBuffer.clear(i, 0, numSamples - firstPart);
         }
     }
+
+    writePosition += numSamples;
+    if (writePosition >= delayBufferSize)
+        writePosition -= delayBufferSize;
 }
 
-//==============================================================================
-bool DigitalDelayAudioProcessor::hasEditor() const
+void DigitalDelayAudioProcessor::updateEcoFactor(bool wetAudible)
 {
-    return true; // (change this to false if you choose to not supply an editor)
+    // switching rates clears the delay line, so while the wet can be heard it first fades out over a block
+    // and the switch happens at the start of the next. The repeats drop out and build up again from the input
+    const bool switching = ecoRequested != ecoFactor;
+    if (switching && wetAudible && ! ecoFadingOut)
+    {
+        ecoFadingOut = true;
+        return;
+    }
+
+    ecoFadingOut = false;
+    if (switching)
+        setEcoFactor(ecoRequested);
 }
 
-juce::AudioProcessorEditor* DigitalDelayAudioProcessor::createEditor()
+void DigitalDelayAudioProcessor::setEcoFactor(int newFactor)
 {
-    return new DigitalDelayAudioProcessorEditor (*this);
+    // the ring shrinks or grows within the capacity reserved in prepareToPlay, its old contents are at the wrong rate
+    ecoFactor = newFactor;
+    delaySampleRate = lastSampleRate / ecoFactor;
+    delayBuffer.setSize(delayBuffer.getNumChannels(), fullRateDelayBufferSize / ecoFactor, false, true, true);
+    writePosition = 0;
+    frozen = false;
+    loopFadePos = 0;
+    readMode = ReadMode::forward;
+    readHeads.prepare(delaySampleRate);
+    grainScheduler.prepare(delaySampleRate);
+    diffuser.setSampleRate(delaySampleRate);
+    resetEcoFilters();
 }
 
-//==============================================================================
-void DigitalDelayAudioProcessor::getStateInformation(juce::MemoryBlock& destData)
+void DigitalDelayAudioProcessor::resetEcoFilters()
 {
-    bool buttonStates[4] = { millisecondsActive, stepsActive, eighthTripletActive, sixteenthNoteActive };
-    auto state = tree.copyState();
-    juce::XmlElement* xmlParent = new juce::XmlElement("parent");
-    juce::XmlElement* xmlSteps  = xmlParent->createNewChildElement(getStepsParamName());
-    juce::XmlElement* xmlMsec   = xmlParent->createNewChildElement(getMsecParamName());
-    juce::XmlElement* xmlButtons = xmlParent->createNewChildElement(juce::String("buttonids"));
-    std::unique_ptr<juce::XmlElement> xml(state.createXml());
+    for (auto& channelFilters : inputDecimators)
+        for (auto& filter : channelFilters)
+            filter.reset();
+    for (auto& channelFilters : wetInterpolators)
+        for (auto& filter : channelFilters)
+            filter.reset();
+    for (auto& carry : wetCarry)
+        std::fill(std::begin(carry), std::end(carry), 0.0f);
+    numWetCarry = 0;
+}
 
-    xmlParent->addChildElement(xml.release());
-    xmlSteps->setAttribute(juce::String("stepsval"), steps);
-    xmlMsec->setAttribute(juce::String("msecval"), msec);
-    
-    for (int i = 0; i < 4; ++i)
-    {
-        xmlButtons->setAttribute(buttonIDs[i], buttonStates[i]);
-    }
-    
-    copyXmlToBinary(*xmlParent, destData);
-    
-    delete xmlParent;
+DigitalDelayAudioProcessor::EcoStats DigitalDelayAudioProcessor::getEcoStats() const
+{
+    EcoStats stats;
+    const size_t bytesPerSample = sizeof(float) * (size_t) delayBuffer.getNumChannels();
+    stats.factor = ecoFactor;
+    stats.delayLineBytes = bytesPerSample * (size_t) delayBuffer.getNumSamples();
+    stats.delayLineBytesSaved = bytesPerSample * (size_t) juce::jmax(0, fullRateDelayBufferSize - delayBuffer.getNumSamples());
+    stats.delayRateFraction = 1.0 / ecoFactor;
+    return stats;
 }
 
-void DigitalDelayAudioProcessor::setStateInformation(const void* data, int sizeInBytes)
+void DigitalDelayAudioProcessor::processWithMidi(juce::AudioSampleBuffer& buffer, const juce::MidiBuffer& midiMessages)
 {
-    bool buttonStates[4] = {false, true, false, true}; //these are set to the original defaults for use in getBoolAttribute
-    std::unique_ptr<juce::XmlElement> xmlState(getXmlFromBinary(data, sizeInBytes));
-    juce::XmlElement* xmlTree = xmlState->getChildByName(tree.state.getType());
-    juce::XmlElement* xmlSteps = xmlState->getChildByName(getStepsParamName());
-    juce::XmlElement* xmlMsec = xmlState->getChildByName(getMsecParamName());
-    juce::XmlElement* xmlButtons = xmlState->getChildByName("buttonids");
+    const int numSamples = buffer.getNumSamples();
+    int start = 0;
 
-    if (xmlState.get() != nullptr)
+    // the block is split at each event that moves the delay, every part runs with the time set before it.
+    // The parts only refer to the host buffer, nothing is copied or allocated
+    for (const auto metadata : midiMessages)
     {
-        if (xmlTree->hasTagName(tree.state.getType()))
-        {
-            tree.replaceState(juce::ValueTree::fromXml(*xmlTree));
-        }
-        if (xmlSteps->hasTagName(getStepsParamName()))
+        const auto message = metadata.getMessage();
+        const int position = juce::jlimit(0, numSamples, metadata.samplePosition);
+
+        if (movesDelay(message) && position > start)
         {
-            steps = xmlSteps->getIntAttribute(juce::String("stepsval"), 15);
+            juce::AudioBuffer<float> part(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), start, position - start);
+            processAtDelayRate(part);
+            start = position;
         }
-        if (xmlMsec->hasTagName(getMsecParamName()))
+        handleMidiEvent(message, midiTime + position);
+    }
+
+    if (start < numSamples)
+    {
+        juce::AudioBuffer<float> part(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), start, numSamples - start);
+        processAtDelayRate(part);
+    }
+    midiTime += numSamples;
+}
+
+bool DigitalDelayAudioProcessor::movesDelay(const juce::MidiMessage& message) const
+{
+    if (! message.isNoteOn())
+        return false;
+
+    const int note = message.getNoteNumber();
+    return note == midiTapNote || (note >= midiDivisionBaseNote && note < midiDivisionBaseNote + maxSteps);
+}
+
+void DigitalDelayAudioProcessor::handleMidiEvent(const juce::MidiMessage& message, juce::int64 time)
+{
+    if (message.isMidiClock())
+    {
+        // a long gap means the clock was stopped, the beat is measured afresh
+        const int lastTick = (clockTickIndex + clocksPerBeat - 1) % clocksPerBeat;
+        if (numClockTicks > 0 && time - clockTickTimes[lastTick] > lastSampleRate / 2)
+            numClockTicks = 0;
+
+        // tempo from the last 24 ticks, one beat, which smooths out jitter in the tick times
+        if (numClockTicks == clocksPerBeat && time > clockTickTimes[clockTickIndex])
+            midiClockTempo = 60.0 * lastSampleRate / (double) (time - clockTickTimes[clockTickIndex]);
+
+        clockTickTimes[clockTickIndex] = time;
+        clockTickIndex = (clockTickIndex + 1) % clocksPerBeat;
+        numClockTicks = juce::jmin(numClockTicks + 1, clocksPerBeat);
+    }
+    else if (message.isMidiStart() || message.isMidiStop() || message.isMidiContinue())
+    {
+        numClockTicks = 0;
+    }
+    else if (movesDelay(message))
+    {
+        const int note = message.getNoteNumber();
+        if (note != midiTapNote)
         {
-            msec = xmlMsec->getIntAttribute(juce::String("msecval"), 130);
+            steps = note - midiDivisionBaseNote + 1;
+            return;
         }
-        
-        if (xmlButtons->hasTagName(juce::String("buttonids")) && xmlButtons != nullptr)
+
+        // two taps up to two seconds apart set the delay in milliseconds, or the beat length in steps
+        const double seconds = (double) (time - lastTapTime) / lastSampleRate;
+        if (lastTapTime >= 0 && seconds > 0.01 && seconds <= 2.0)
         {
-            for (int i = 0; i < 4; ++i)
-                buttonStates[i] = xmlButtons->getBoolAttribute(buttonIDs[i], buttonStates[i]);
+            if (isMillisecondsActive())
+                msec = juce::roundToInt(seconds * 1000.0);
+            else
+                tapTempo = 60.0 / seconds;
         }
-        setMillisecondsActive(buttonStates[0]);
-        setStepsActive(buttonStates[1]);
-        setEighthTripletActive(buttonStates[2]);
-        setSixteenthNoteActive(buttonStates[3]);
+        lastTapTime = time;
     }
-    convertStepsToMsec();
 }
 
-//==============================================================================
-// This creates new instances of the plugin..
-juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
+bool DigitalDelayAudioProcessor::pushTimeCommand(TimeCommand command, int value)
 {
-    return new DigitalDelayAudioProcessor();
+    JUCE_ASSERT_MESSAGE_THREAD
+
+    int start1, size1, start2, size2;
+    timeCommandFifo.prepareToWrite(1, start1, size1, start2, size2);
+    if (size1 == 0)
+        return false;
+
+    timeCommands[start1] = { command, value, timeRestoreGeneration.load() };
+    timeCommandFifo.finishedWrite(1);
+    return true;
+}
+
+void DigitalDelayAudioProcessor::applyTimeCommands()
+{
+    takePendingTimeRestore();
+
+    int start1, size1, start2, size2;
+    timeCommandFifo.prepareToRead(timeCommandFifo.getNumReady(), start1, size1, start2, size2);
+    for (int i = 0; i < size1; ++i)
+        applyTimeCommand(timeCommands[start1 + i]);
+    for (int i = 0; i < size2; ++i)
+        applyTimeCommand(timeCommands[start2 + i]);
+    timeCommandFifo.finishedRead(size1 + size2);
+
+    // MIDI in the last block may have moved the time too, so this runs every block
+    publishTimeState();
+}
+
+void DigitalDelayAudioProcessor::applyTimeCommand(const QueuedTimeCommand& queued)
+{
+    // a command queued after a restore that hasn't been taken yet waits for it, one queued before a restore is dropped
+    if (queued.restoreGeneration != appliedRestoreGeneration)
+        takePendingTimeRestore();
+    if (queued.restoreGeneration != appliedRestoreGeneration)
+        return;
+
+    switch (queued.command)
+    {
+        case TimeCommand::useMilliseconds:
+            convertStepsToMsec();
+            stepsActive = false;
+            millisecondsActive = true;
+            break;
+
+        case TimeCommand::useSteps:
+            millisecondsActive = false;
+            stepsActive = true;
+            break;
+
+        case TimeCommand::useSixteenthNotes:
+            sixteenthNoteActive = true;
+            eighthTripletActive = false;
+            break;
+
+        case TimeCommand::useEighthTriplets:
+            eighthTripletActive = true;
+            sixteenthNoteActive = false;
+            break;
+
+        case TimeCommand::setValue:
+        case TimeCommand::nudgeValue:
+        {
+            const bool nudge = queued.command == TimeCommand::nudgeValue;
+            if (isStepsActive())
+                steps = juce::jlimit(1, maxSteps, nudge ? steps + queued.value : queued.value);
+            else
+                msec = juce::jlimit(1, maxMilliseconds, nudge ? msec + queued.value : queued.value);
+            break;
+        }
+    }
+    convertStepsToMsec();
+}
+
+void DigitalDelayAudioProcessor::takePendingTimeRestore()
+{
+    const auto pending = pendingTimeRestore.exchange(0, std::memory_order_acquire);
+    if (pending == 0)
+        return;
+
+    appliedRestoreGeneration = (juce::uint32) (pending >> 32);
+    const auto state = unpackTimeState((juce::uint32) pending);
+    msec = juce::jlimit(1, maxMilliseconds, state.msec);
+    steps = juce::jlimit(1, maxSteps, state.steps);
+    millisecondsActive = state.millisecondsActive;
+    stepsActive = ! state.millisecondsActive;
+    eighthTripletActive = state.eighthTripletActive;
+    sixteenthNoteActive = ! state.eighthTripletActive;
+    convertStepsToMsec();
+}
+
+void DigitalDelayAudioProcessor::publishTimeState()
+{
+    TimeState current;
+    current.msec = msec;
+    current.steps = steps;
+    current.millisecondsActive = millisecondsActive;
+    current.eighthTripletActive = eighthTripletActive;
+    const auto state = packTimeState(current);
+
+    // packed into one word so the editor can never see half an update
+    if (publishedTimeState.exchange(state, std::memory_order_relaxed) != state)
+        timeStateVersion.fetch_add(1, std::memory_order_release);
+}
+
+DigitalDelayAudioProcessor::TimeState DigitalDelayAudioProcessor::getTimeState() const noexcept
+{
+    return unpackTimeState(publishedTimeState.load(std::memory_order_relaxed));
+}
+
+juce::uint32 DigitalDelayAudioProcessor::packTimeState(const TimeState& state) noexcept
+{
+    return (juce::uint32) juce::jlimit(0, 0xffff, state.msec)
+         | (juce::uint32) juce::jlimit(0, 0xff, state.steps) << 16
+         | (state.millisecondsActive ? 1u << 24 : 0u)
+         | (state.eighthTripletActive ? 1u << 25 : 0u);
+}
+
+DigitalDelayAudioProcessor::TimeState DigitalDelayAudioProcessor::unpackTimeState(juce::uint32 packed) noexcept
+{
+    TimeState state;
+    state.msec = (int) (packed & 0xffff);
+    state.steps = (int) ((packed >> 16) & 0xff);
+    state.millisecondsActive = (packed & (1u << 24)) != 0;
+    state.eighthTripletActive = (packed & (1u << 25)) != 0;
+    return state;
+}
+
+void DigitalDelayAudioProcessor::processAtDelayRate(juce::AudioSampleBuffer& buffer)
+{
+    if (spectralRequested || spectralActive)
+    {
+        processSpectral(buffer);
+        return;
+    }
+
+    if (ecoFactor == 1)
+        processDelay(buffer);
+    else
+        processDecimated(buffer);
+}
+
+void DigitalDelayAudioProcessor::writeAtDelayRate(const juce::AudioSampleBuffer& buffer, bool feedInput)
+{
+    if (ecoFactor == 1)
+    {
+        writeBypassedToDelayBuffer(buffer, feedInput);
+        return;
+    }
+
+    // nothing is interpolated here, the carry count still has to follow the decimators' phase
+    const int numDecimated = decimateInput(buffer);
+    const juce::AudioBuffer<float> decimated(ecoBuffer.getArrayOfWritePointers(), buffer.getNumChannels(), numDecimated);
+    writeBypassedToDelayBuffer(decimated, feedInput);
+    numWetCarry += ecoFactor * numDecimated - buffer.getNumSamples();
+}
+
+void DigitalDelayAudioProcessor::processSpectral(juce::AudioSampleBuffer& buffer)
+{
+    const int numSamples = buffer.getNumSamples();
+    const int numChannels = juce::jmin(buffer.getNumChannels(), SpectralDelay::maxChannels);
+
+    // a new size starts from an empty history, all the buffers for it were made in prepareToPlay
+    const bool entering = spectralRequested && ! spectralActive;
+    const bool leaving = ! spectralRequested;
+    if (spectralDelay.getOrder() != spectralOrderRequested)
+        spectralDelay.setOrder(spectralOrderRequested);
+    else if (entering)
+        spectralDelay.reset();
+    if (entering)
+        spectralDiffuser.reset();
+
+    // the time domain engine runs in full for the block that crossfades between the two,
+    // otherwise its delay line just keeps taking the input so switching back finds it filled
+    const float dryStartGain = lastDryGain;
+    if (entering || leaving)
+    {
+        spectralScratch.makeCopyOf(buffer, true);
+        spectralScratchWet.clear();
+        holdingCapturedWet = true;
+        if (ecoFactor == 1)
+            processDelay(spectralScratch);
+        else
+            processDecimated(spectralScratch);
+        holdingCapturedWet = false;
+
+        // the read modes stay on the time domain side, which starts afresh with them when spectral is left
+        if (entering)
+        {
+            frozen = false;
+            loopFadePos = 0;
+            readMode = ReadMode::forward;
+        }
+    }
+    else
+    {
+        updateTempo();
+        writeAtDelayRate(buffer, true);
+    }
+
+    spectralSettings.delaySamples = lastSampleRate * msec / 1000.0f;
+    spectralSettings.feedback = feedback;
+    spectralDelay.process(buffer.getArrayOfReadPointers(), spectralDryBuffer.getArrayOfWritePointers(),
+        spectralWetBuffer.getArrayOfWritePointers(), numChannels, numSamples, spectralSettings);
+
+    // the dry comes back from the engine as late as the wet, which is the latency reported to the host
+    const StereoMatrix wetMatrix = getWetMatrix();
+    float* const* wet = spectralWetBuffer.getArrayOfWritePointers();
+    const bool stereo = numChannels > 1;
+    VectorOps::applyStereoMatrix(wet[0], stereo ? wet[1] : nullptr, wet[0], stereo ? wet[1] : nullptr,
+        numSamples, lastWetMatrix, wetMatrix, false);
+    lastWetMatrix = wetMatrix;
+
+    // there is no time domain loop to put it in, so either placement diffuses the spectral wet
+    if (diffusionPlacement != DiffusionPlacement::off && numChannels > 0)
+        spectralDiffuser.process(wet[0], stereo ? wet[1] : nullptr, numSamples);
+
+    for (int i = 0; i < numChannels; ++i)
+    {
+        buffer.copyFromWithRamp(i, 0, spectralDryBuffer.getReadPointer(i), numSamples, dryStartGain, dryGain);
+        buffer.addFrom(i, 0, spectralWetBuffer, i, 0, numSamples);
+    }
+    lastDryGain = dryGain;
+
+    const float spectralStartGain = leaving ? 1.0f : 0.0f;
+    const float spectralEndGain = leaving ? 0.0f : 1.0f;
+    if (wetCapture.isCapturing())
+    {
+        // the captured wet crossfades the same way as the output
+        juce::AudioBuffer<float> capturedWet(spectralWetBuffer.getArrayOfWritePointers(), numChannels, numSamples);
+        if (entering || leaving)
+        {
+            for (int i = 0; i < numChannels; ++i)
+            {
+                capturedWet.applyGainRamp(i, 0, numSamples, spectralStartGain, spectralEndGain);
+                capturedWet.addFromWithRamp(i, 0, spectralScratchWet.getReadPointer(i), numSamples, spectralEndGain, spectralStartGain);
+            }
+        }
+        wetCapture.push(capturedWet, numSamples);
+    }
+
+    if (entering || leaving)
+    {
+        for (int i = 0; i < numChannels; ++i)
+        {
+            buffer.applyGainRamp(i, 0, numSamples, spectralStartGain, spectralEndGain);
+            buffer.addFromWithRamp(i, 0, spectralScratch.getReadPointer(i), numSamples, spectralEndGain, spectralStartGain);
+        }
+    }
+    spectralActive = spectralRequested;
+}
+
+void DigitalDelayAudioProcessor::captureWet(const juce::AudioSampleBuffer& wet, int numSamples)
+{
+    if (! holdingCapturedWet)
+    {
+        wetCapture.push(wet, numSamples);
+        return;
+    }
+
+    for (int i = 0; i < juce::jmin(wet.getNumChannels(), spectralScratchWet.getNumChannels()); ++i)
+        spectralScratchWet.copyFrom(i, 0, wet, i, 0, numSamples);
+}
+
+int DigitalDelayAudioProcessor::decimateInput(const juce::AudioSampleBuffer& buffer)
+{
+    const int numChannels = juce::jmin(buffer.getNumChannels(), ecoBuffer.getNumChannels(), maxEcoChannels);
+    int numDecimated = 0;
+
+    for (int i = 0; i < numChannels; ++i)
+    {
+        if (ecoFactor == 2)
+        {
+            numDecimated = inputDecimators[i][0].decimate(buffer.getReadPointer(i), buffer.getNumSamples(), ecoBuffer.getWritePointer(i));
+        }
+        else
+        {
+            const int numHalf = inputDecimators[i][0].decimate(buffer.getReadPointer(i), buffer.getNumSamples(), ecoStageBuffer.getWritePointer(i));
+            numDecimated = inputDecimators[i][1].decimate(ecoStageBuffer.getReadPointer(i), numHalf, ecoBuffer.getWritePointer(i));
+        }
+    }
+
+    return numDecimated;
+}
+
+void DigitalDelayAudioProcessor::processDecimated(juce::AudioSampleBuffer& buffer)
+{
+    const int numSamples = buffer.getNumSamples();
+    const int numChannels = juce::jmin(buffer.getNumChannels(), ecoBuffer.getNumChannels(), maxEcoChannels);
+
+    // the whole engine, feedback included, runs on the decimated input
+    const int numDecimated = decimateInput(buffer);
+    juce::AudioBuffer<float> decimated(ecoBuffer.getArrayOfWritePointers(), numChannels, numDecimated);
+    for (int i = 0; i < numChannels; ++i)
+        ecoDryBuffer.copyFrom(i, 0, ecoBuffer, i, 0, numDecimated);
+
+    const float dryStartGain = lastDryGain;
+    if (numDecimated > 0)
+        processDelay(decimated);
+    const float dryEndGain = lastDryGain;
+
+    // taking the engine's own dry signal back out leaves the wet, which is interpolated up to the host rate.
+    // Samples left over from the last block come first, the interpolators always produce at least numSamples
+    const int numAvailable = numWetCarry + ecoFactor * numDecimated;
+    jassert(numAvailable >= numSamples);
+
+    for (int i = 0; i < numChannels; ++i)
+    {
+        decimated.addFromWithRamp(i, 0, ecoDryBuffer.getReadPointer(i), numDecimated, -dryStartGain, -dryEndGain);
+
+        float* wet = ecoWetBuffer.getWritePointer(i);
+        std::copy(wetCarry[i], wetCarry[i] + numWetCarry, wet);
+        if (ecoFactor == 2)
+        {
+            wetInterpolators[i][0].interpolate(decimated.getReadPointer(i), numDecimated, wet + numWetCarry);
+        }
+        else
+        {
+            wetInterpolators[i][0].interpolate(decimated.getReadPointer(i), numDecimated, ecoStageBuffer.getWritePointer(i));
+            wetInterpolators[i][1].interpolate(ecoStageBuffer.getReadPointer(i), 2 * numDecimated, wet + numWetCarry);
+        }
+        std::copy(wet + numSamples, wet + numAvailable, wetCarry[i]);
+
+        buffer.applyGainRamp(i, 0, numSamples, dryStartGain, dryEndGain);
+        buffer.addFrom(i, 0, wet, numSamples);
+    }
+    numWetCarry = numAvailable - numSamples;
+
+    if (wetCapture.isCapturing())
+        captureWet(juce::AudioBuffer<float>(ecoWetBuffer.getArrayOfWritePointers(), numChannels, numSamples), numSamples);
+}
+
+void DigitalDelayAudioProcessor::updateTempo()
+{
+    // the host tempo comes first, then MIDI clock, then tap tempo
+    playHead = this->getPlayHead();
+    if (playHead != nullptr && playHead->getCurrentPosition(sessionInfo) && sessionInfo.bpm > 0.0)
+        tempo = sessionInfo.bpm;
+    else if (midiClockTempo > 0.0)
+        tempo = midiClockTempo;
+    else if (tapTempo > 0.0)
+        tempo = tapTempo;
+    convertStepsToMsec();
+}
+
+void DigitalDelayAudioProcessor::processDelay(juce::AudioSampleBuffer& buffer)
+{
+    updateTempo();
+
+    if (Bus* inputBus = getBus(true, 0))
+    {
+        const float gain = dryGain;
+        const StereoMatrix wetMatrix = getWetMatrix();
+        const StereoMatrix wetStartMatrix = lastWetMatrix;
+        lastWetMatrix = wetMatrix;
+        const float time = msec;
+        const float feedback = this->feedback;
+        const int delaySamples = juce::roundToInt(delaySampleRate * time / 1000.0);
+
+        // freeze holds the current delay window, nothing is written to the delay line until it is released.
+        // A new freeze waits for the loop of the last one to finish fading out
+        const bool releasingFreeze = frozen && ! freezeRequested;
+        if (freezeRequested && ! frozen && loopFadePos == 0)
+            startFreeze(delaySamples);
+        else if (releasingFreeze)
+            releaseFreeze();
+
+        // the read mode switches on a block boundary, the old read fades out over that block as the new one fades in
+        const ReadMode previousReadMode = readMode;
+        readMode = reverseRequested ? ReadMode::reverse : granularRequested ? ReadMode::granular : ReadMode::forward;
+        if (readMode != previousReadMode)
+        {
+            if (readMode == ReadMode::reverse)
+                startReverse(delaySamples);
+            else if (readMode == ReadMode::granular)
+                grainScheduler.reset();
+        }
+
+        // read delayed signal
+        auto readPos = juce::roundToInt(writePosition - (delaySampleRate * time / 1000.0));
+        if (readPos < 0)
+            readPos += delayBuffer.getNumSamples();
+
+        // the plain forward delay runs as a single fused pass, everything else goes through the stages below
+        Bus* mainOutputBus = getBus(false, 0);
+        const int numDelayChannels = delayBuffer.getNumChannels();
+        const bool useFusedKernel = fusedProcessingEnabled && ! frozen && loopFadePos == 0
+            && readMode == ReadMode::forward && previousReadMode == ReadMode::forward
+            && mainOutputBus != nullptr && numDelayChannels <= 2
+            && inputBus->getNumberOfChannels() == numDelayChannels
+            && mainOutputBus->getNumberOfChannels() == numDelayChannels
+            && diffusionPlacement == DiffusionPlacement::off;
+
+        if (useFusedKernel)
+        {
+            const bool capturingWet = wetCapture.isCapturing() && ecoFactor == 1;
+            if (capturingWet)
+                wetBuffer.setSize(buffer.getNumChannels(), buffer.getNumSamples(), false, false, true);
+
+            readHeads.retarget(readPos);
+            processFused(buffer, wetStartMatrix, wetMatrix, lastDryGain, gain, lastFeedback, feedback, capturingWet);
+            lastDryGain = gain;
+            lastFeedback = feedback;
+
+            if (capturingWet)
+                captureWet(wetBuffer, buffer.getNumSamples());
+
+            writePosition += buffer.getNumSamples();
+            if (writePosition >= delayBuffer.getNumSamples())
+                writePosition -= delayBuffer.getNumSamples();
+            return;
+        }
+
+        // write original to delay
+        if (! frozen)
+        {
+            for (int i = 0; i < delayBuffer.getNumChannels(); ++i)
+            {
+                const int inputChannelNum = inputBus->getChannelIndexInProcessBlockBuffer(std::min(i, inputBus->getNumberOfChannels()));
+                writeToDelayBuffer(buffer, inputChannelNum, i, writePosition, 1.0f, 1.0f, true);
+            }
+        }
+
+        // adapt dry gain
+        buffer.applyGainRamp(0, buffer.getNumSamples(), lastDryGain, gain);
+        lastDryGain = gain;
+
+        if (Bus* outputBus = mainOutputBus)
+        {
+            // while printing or diffusing the wet signal it is built up on its own before being mixed in
+            const bool capturingWet = wetCapture.isCapturing() && ecoFactor == 1;
+            const bool diffusingWet = diffusionPlacement == DiffusionPlacement::wet;
+            const bool separateWet = capturingWet || diffusingWet;
+            if (separateWet)
+            {
+                wetBuffer.setSize(buffer.getNumChannels(), buffer.getNumSamples(), false, false, true);
+                wetBuffer.clear();
+            }
+            juce::AudioSampleBuffer& wetTarget = separateWet ? wetBuffer : buffer;
+
+            if (frozen || loopFadePos > 0)
+            {
+                // after the release the loop fades out over the read head fade, while the normal read fades back in below
+                readFromFrozenLoop(wetTarget, *outputBus, wetStartMatrix, wetMatrix);
+                freezePhase = (freezePhase + buffer.getNumSamples()) % freezeLength;
+            }
+
+            if (! frozen)
+            {
+                for (auto mode : { ReadMode::reverse, ReadMode::granular })
+                {
+                    if (mode != readMode && mode != previousReadMode)
+                        continue;
+
+                    const StereoMatrix startMatrix = (mode != previousReadMode || releasingFreeze) ? StereoMatrix::silence() : wetStartMatrix;
+                    const StereoMatrix endMatrix = (mode != readMode) ? StereoMatrix::silence() : wetMatrix;
+                    if (mode == ReadMode::reverse)
+                        readReversedFromDelayBuffer(wetTarget, *outputBus, startMatrix, endMatrix, delaySamples);
+                    else
+                        readGrainsFromDelayBuffer(wetTarget, *outputBus, startMatrix, endMatrix, delaySamples);
+                }
+            }
+
+            // forward read, a jump in readPos crossfades to a new head and fades carry on into the next blocks
+            if (! frozen)
+            {
+                if (readMode == ReadMode::forward)
+                    readHeads.retarget(readPos);
+                else
+                    readHeads.fadeOutAll();
+            }
+
+            if (readHeads.isPlaying())
+            {
+                int outputChannels[2] = { 0, 0 };
+                const int numChannels = juce::jmin(2, outputBus->getNumberOfChannels());
+                for (int i = 0; i < numChannels; ++i)
+                    outputChannels[i] = outputBus->getChannelIndexInProcessBlockBuffer(i);
+                readHeads.process(delayBuffer, wetTarget, outputChannels, numChannels, buffer.getNumSamples(), wetStartMatrix, wetMatrix);
+            }
+
+            if (separateWet)
+            {
+                if (diffusingWet)
+                    diffuse(wetBuffer, *outputBus);
+                if (capturingWet)
+                    captureWet(wetBuffer, buffer.getNumSamples());
+                for (int i = 0; i < outputBus->getNumberOfChannels(); ++i)
+                {
+                    const int outputChannelNum = outputBus->getChannelIndexInProcessBlockBuffer(i);
+                    buffer.addFrom(outputChannelNum, 0, wetBuffer, outputChannelNum, 0, buffer.getNumSamples());
+                }
+            }
+        }
+
+        // the frozen loop is read-only, the write position waits for the release
+        if (frozen)
+            return;
+
+        // add feedback to delay, through the diffuser when it sits in the loop so each repeat smears further
+        juce::AudioSampleBuffer* feedbackSource = &buffer;
+        if (diffusionPlacement == DiffusionPlacement::feedback)
+        {
+            diffusionBuffer.makeCopyOf(buffer, true);
+            diffuse(diffusionBuffer, *inputBus);
+            feedbackSource = &diffusionBuffer;
+        }
+
+        for (int i = 0; i < inputBus->getNumberOfChannels(); ++i)
+        {
+            const int outputChannelNum = inputBus->getChannelIndexInProcessBlockBuffer(i);
+            writeToDelayBuffer(*feedbackSource, outputChannelNum, i, writePosition, lastFeedback, feedback, false);
+        }
+        lastFeedback = feedback;
+
+        // advance positions
+        writePosition += buffer.getNumSamples();
+        if (writePosition >= delayBuffer.getNumSamples())
+            writePosition -= delayBuffer.getNumSamples();
+    }
+}
+
+void DigitalDelayAudioProcessor::updateDiffusionStages()
+{
+    if (diffusionStagesRequested == diffuser.getNumStages())
+        return;
+
+    diffuser.setNumStages(diffusionStagesRequested);
+    spectralDiffuser.setNumStages(diffusionStagesRequested);
 }
 
-juce::String DigitalDelayAudioProcessor::getFeedbackParamName()
+void DigitalDelayAudioProcessor::diffuse(juce::AudioSampleBuffer& buffer, Bus& bus)
+{
+    const int numChannels = bus.getNumberOfChannels();
+    if (numChannels == 0)
+        return;
+
+    float* left = buffer.getWritePointer(bus.getChannelIndexInProcessBlockBuffer(0));
+    float* right = numChannels > 1 ? buffer.getWritePointer(bus.getChannelIndexInProcessBlockBuffer(1)) : nullptr;
+    diffuser.process(left, right, buffer.getNumSamples());
+}
+
+void DigitalDelayAudioProcessor::writeToDelayBuffer(juce::AudioSampleBuffer& buffer,
+    const int channelIn, const int channelOut,
+    const int writePos, float startGain, float endGain, bool replacing)
+{
+    if (writePos + buffer.getNumSamples() <= delayBuffer.getNumSamples())
+    {
+        if (replacing)
+            delayBuffer.copyFromWithRamp(channelOut, writePos, buffer.getReadPointer(channelIn), buffer.getNumSamples(), startGain, endGain);
+        else
+            delayBuffer.addFromWithRamp(channelOut, writePos, buffer.getReadPointer(channelIn), buffer.getNumSamples(), startGain, endGain);
+    }
+    else
+    {
+        const auto midPos = delayBuffer.getNumSamples() - writePos;
+        const auto midGain = juce::jmap(float(midPos) / buffer.getNumSamples(), startGain, endGain);
+        if (replacing)
+        {
+            delayBuffer.copyFromWithRamp(channelOut, writePos, buffer.getReadPointer(channelIn), midPos, startGain, midGain);
+            delayBuffer.copyFromWithRamp(channelOut, 0, buffer.getReadPointer(channelIn, midPos), buffer.getNumSamples() - midPos, midGain, endGain);
+        }
+        else
+        {
+            delayBuffer.addFromWithRamp(channelOut, writePos, buffer.getReadPointer(channelIn), midPos, lastDryGain, midGain);
+            delayBuffer.addFromWithRamp(channelOut, 0, buffer.getReadPointer(channelIn, midPos), buffer.getNumSamples() - midPos, midGain, endGain);
+        }
+    }
+}
+
+void DigitalDelayAudioProcessor::readFromDelayBuffer(juce::AudioSampleBuffer& buffer,
+    const int channelIn, const int channelOut,
+    const int readPos,
+    float startGain, float endGain,
+    bool replacing)
+{
+    if (readPos + buffer.getNumSamples() <= delayBuffer.getNumSamples())
+    {
+        if (replacing)
+            buffer.copyFromWithRamp(channelOut, 0, delayBuffer.getReadPointer(channelIn, readPos), buffer.getNumSamples(), startGain, endGain);
+        else
+            buffer.addFromWithRamp(channelOut, 0, delayBuffer.getReadPointer(channelIn, readPos), buffer.getNumSamples(), startGain, endGain);
+    }
+    else
+    {
+        const auto midPos = delayBuffer.getNumSamples() - readPos;
+        const auto midGain = juce::jmap(float(midPos) / buffer.getNumSamples(), startGain, endGain);
+        if (replacing)
+        {
+            buffer.copyFromWithRamp(channelOut, 0, delayBuffer.getReadPointer(channelIn, readPos), midPos, startGain, midGain);
+            buffer.copyFromWithRamp(channelOut, midPos, delayBuffer.getReadPointer(channelIn), buffer.getNumSamples() - midPos, midGain, endGain);
+        }
+        else
+        {
+            buffer.addFromWithRamp(channelOut, 0, delayBuffer.getReadPointer(channelIn, readPos), midPos, startGain, midGain);
+            buffer.addFromWithRamp(channelOut, midPos, delayBuffer.getReadPointer(channelIn), buffer.getNumSamples() - midPos, midGain, endGain);
+        }
+    }
+}
+
+void DigitalDelayAudioProcessor::startFreeze(int loopLength)
+{
+    const int delayBufferSize = delayBuffer.getNumSamples();
+    freezeLength = juce::jlimit(1, delayBufferSize - 1, loopLength);
+
+    // the loop end crossfades into the audio just before the loop start, which is still in the delay line
+    freezeFadeLength = juce::jmin(juce::roundToInt(delaySampleRate * 0.02), freezeLength / 2, delayBufferSize - freezeLength);
+
+    freezeStart = writePosition - freezeLength;
+    if (freezeStart < 0)
+        freezeStart += delayBufferSize;
+    freezePhase = 0;
+    frozen = true;
+
+    // the loop starts where the forward read is, so it carries on with the main head's gain and only the
+    // heads still fading out from a time change go on fading
+    loopFadeLength = readHeads.getFadeLength();
+    loopFadePos = juce::roundToInt(readHeads.handOverMainHead(freezeStart) * loopFadeLength);
+}
+
+void DigitalDelayAudioProcessor::releaseFreeze()
+{
+    frozen = false;
+
+    // writing starts again at the loop end and reaches the samples the loop reads after the free part of the
+    // delay line, so a loop that fills nearly all of it fades out faster, from the gain it has now
+    const int maxFadeLength = juce::jmax(1, delayBuffer.getNumSamples() - freezeLength - freezeFadeLength);
+    if (loopFadeLength > maxFadeLength)
+    {
+        loopFadePos = (int) ((juce::int64) loopFadePos * maxFadeLength / loopFadeLength);
+        loopFadeLength = maxFadeLength;
+    }
+}
+
+void DigitalDelayAudioProcessor::readFromFrozenLoop(juce::AudioSampleBuffer& buffer, Bus& outputBus,
+    const StereoMatrix& startMatrix, const StereoMatrix& endMatrix)
+{
+    constexpr int chunkSize = ReadHeadPool::chunkSize;
+    const int numSamples = buffer.getNumSamples();
+
+    // the loop's own fade runs up while frozen and down after the release. While it moves the matrix ramp is
+    // split every chunk so the gain follows the equal power curve
+    const int fadeDirection = frozen ? 1 : -1;
+    const int loopFadeStart = loopFadePos;
+    const bool loopFading = frozen ? loopFadeStart < loopFadeLength : loopFadeStart > 0;
+    loopFadePos = juce::jlimit(0, loopFadeLength, loopFadeStart + fadeDirection * numSamples);
+
+    const int numChannels = juce::jmin(outputBus.getNumberOfChannels(), delayBuffer.getNumChannels(), 2);
+    if (numChannels == 0)
+        return;
+
+    const bool stereo = numChannels > 1;
+    const int delayBufferSize = delayBuffer.getNumSamples();
+    const int fadeStart = freezeLength - freezeFadeLength;
+    const double fadeIncrement = 1.0 / juce::jmax(1, freezeFadeLength);
+    float* outLeft = buffer.getWritePointer(outputBus.getChannelIndexInProcessBlockBuffer(0));
+    float* outRight = stereo ? buffer.getWritePointer(outputBus.getChannelIndexInProcessBlockBuffer(1)) : nullptr;
+    float fadeIn[chunkSize], fadeOut[chunkSize];
+    float crossfaded[2][chunkSize];
+
+    auto getMatrixAt = [&](int sample)
+    {
+        const auto matrix = StereoMatrix::interpolate(startMatrix, endMatrix, float(sample) / numSamples);
+        const int fadePos = juce::jlimit(0, loopFadeLength, loopFadeStart + fadeDirection * sample);
+        if (fadePos == loopFadeLength)
+            return matrix;
+        return StereoMatrix::interpolate(StereoMatrix::silence(), matrix, equalPowerTable((double) fadePos / loopFadeLength));
+    };
+
+    int phase = freezePhase;
+    int done = 0;
+    while (done < numSamples)
+    {
+        int readPos = freezeStart + phase;
+        if (readPos >= delayBufferSize)
+            readPos -= delayBufferSize;
+
+        int num;
+        const float* sources[2];
+        if (phase < fadeStart)
+        {
+            // body of the loop: straight from the delay line up to the fade, the end of the block or the end of the delay line
+            num = juce::jmin(numSamples - done, fadeStart - phase, delayBufferSize - readPos);
+            if (loopFading)
+                num = juce::jmin(num, chunkSize);
+            for (int c = 0; c < numChannels; ++c)
+                sources[c] = delayBuffer.getReadPointer(c, readPos);
+        }
+        else
+        {
+            // equal power crossfade from the loop end into the samples that led up to the loop start, a chunk at a time
+            num = juce::jmin(numSamples - done, freezeLength - phase, chunkSize);
+            int preReadPos = freezeStart - freezeFadeLength + (phase - fadeStart);
+            if (preReadPos < 0)
+                preReadPos += delayBufferSize;
+
+            const double fadePhase = (phase - fadeStart + 0.5) * fadeIncrement;
+            equalPowerTable.fill(fadeIn, fadePhase, fadeIncrement, num);
+            equalPowerTable.fill(fadeOut, 1.0 - fadePhase, -fadeIncrement, num);
+
+            for (int c = 0; c < numChannels; ++c)
+            {
+                const float* delayData = delayBuffer.getReadPointer(c);
+                int loopPos = readPos;
+                int prePos = preReadPos;
+                for (int i = 0; i < num; ++i)
+                {
+                    crossfaded[c][i] = fadeOut[i] * delayData[loopPos] + fadeIn[i] * delayData[prePos];
+
+                    if (++loopPos == delayBufferSize)
+                        loopPos = 0;
+                    if (++prePos == delayBufferSize)
+                        prePos = 0;
+                }
+                sources[c] = crossfaded[c];
+            }
+        }
+
+        // straight through the wet matrix into the output, the matrix ramp split at the same points as the reads
+        VectorOps::applyStereoMatrix(outLeft + done, stereo ? outRight + done : nullptr,
+            sources[0], stereo ? sources[1] : nullptr, num, getMatrixAt(done), getMatrixAt(done + num), true);
+
+        done += num;
+        phase += num;
+        if (phase >= freezeLength)
+            phase = 0;
+    }
+}
+
+void DigitalDelayAudioProcessor::startReverse(int segmentLength)
+{
+    const int delayBufferSize = delayBuffer.getNumSamples();
+    reverseLength = getReverseLength(segmentLength);
+    buildReverseWindow();
+
+    // the second head starts half way through a segment so the two windows always sum to one
+    reverseHeads[0].anchor = writePosition - 1;
+    reverseHeads[0].phase = 0;
+    reverseHeads[1].anchor = writePosition - reverseLength / 2 - 1;
+    reverseHeads[1].phase = reverseLength / 2;
+
+    for (auto& head : reverseHeads)
+        if (head.anchor < 0)
+            head.anchor += delayBufferSize;
+}
+
+int DigitalDelayAudioProcessor::getReverseLength(int segmentLength) const
+{
+    // even, so the second head is exactly half a segment behind
+    return 2 * juce::jlimit(1, delayBuffer.getNumSamples() / 4, segmentLength / 2);
+}
+
+void DigitalDelayAudioProcessor::buildReverseWindow()
+{
+    // once per segment length rather than per sample, so the heads only have to multiply by it
+    if (reverseWindowLength == reverseLength)
+        return;
+
+    jassert(reverseLength <= reverseWindow.getNumSamples());
+    windowTable.fill(reverseWindow.getWritePointer(0), 0.0, 1.0 / reverseLength, reverseLength);
+    reverseWindowLength = reverseLength;
+}
+
+void DigitalDelayAudioProcessor::readReversedFromDelayBuffer(juce::AudioSampleBuffer& buffer, Bus& outputBus,
+    const StereoMatrix& startMatrix, const StereoMatrix& endMatrix,
+    const int segmentLength)
+{
+    constexpr int chunkSize = ReadHeadPool::chunkSize;
+    const int numSamples = buffer.getNumSamples();
+    const int delayBufferSize = delayBuffer.getNumSamples();
+    const int numChannels = juce::jmin(outputBus.getNumberOfChannels(), delayBuffer.getNumChannels(), 2);
+    const bool stereo = numChannels > 1;
+    float* outLeft = numChannels > 0 ? buffer.getWritePointer(outputBus.getChannelIndexInProcessBlockBuffer(0)) : nullptr;
+    float* outRight = stereo ? buffer.getWritePointer(outputBus.getChannelIndexInProcessBlockBuffer(1)) : nullptr;
+    float mix[2][chunkSize];
+    float* const mixChannels[2] = { mix[0], mix[1] };
+
+    auto& first = reverseHeads[0];
+    auto& second = reverseHeads[1];
+    int done = 0;
+    while (done < numSamples)
+    {
+        // the pair only takes on a new delay time where the first head starts a segment. The second is
+        // at the top of its window there, it keeps its read position and carries on at the new length's
+        // half way point, so neither window jumps and the two still sum to one
+        if (first.phase >= reverseLength)
+        {
+            const int newLength = getReverseLength(segmentLength);
+            if (newLength != reverseLength)
+            {
+                const int readPos = (second.anchor - second.phase + delayBufferSize) % delayBufferSize;
+                reverseLength = newLength;
+                buildReverseWindow();
+                second.phase = reverseLength / 2;
+                second.anchor = (readPos + second.phase) % delayBufferSize;
+            }
+            first.phase = 0;
+            first.anchor = (writePosition + done - 1 + delayBufferSize) % delayBufferSize;
+        }
+
+        // a new segment starts from the newest sample
+        if (second.phase >= reverseLength)
+        {
+            second.phase = 0;
+            second.anchor = (writePosition + done - 1 + delayBufferSize) % delayBufferSize;
+        }
+
+        // both heads are summed a chunk at a time and go through the wet matrix straight into the output
+        const int num = juce::jmin(numSamples - done, reverseLength - first.phase, reverseLength - second.phase, chunkSize);
+        for (int c = 0; c < numChannels; ++c)
+            juce::FloatVectorOperations::clear(mix[c], num);
+        readReverseHead(first, mixChannels, numChannels, num);
+        readReverseHead(second, mixChannels, numChannels, num);
+
+        if (numChannels > 0)
+            VectorOps::applyStereoMatrix(outLeft + done, stereo ? outRight + done : nullptr,
+                mix[0], stereo ? mix[1] : nullptr, num,
+                StereoMatrix::interpolate(startMatrix, endMatrix, float(done) / numSamples),
+                StereoMatrix::interpolate(startMatrix, endMatrix, float(done + num) / numSamples), true);
+        done += num;
+    }
+}
+
+void DigitalDelayAudioProcessor::readReverseHead(ReverseHead& head, float* const* dest, int numChannels, int numSamples)
+{
+    const int delayBufferSize = delayBuffer.getNumSamples();
+
+    int done = 0;
+    while (done < numSamples)
+    {
+        int readPos = head.anchor - head.phase;
+        if (readPos < 0)
+            readPos += delayBufferSize;
+
+        // walking backwards the run is contiguous down to index 0 of the delay line
+        const int num = juce::jmin(numSamples - done, readPos + 1);
+        const float* window = reverseWindow.getReadPointer(0, head.phase);
+
+        for (int i = 0; i < numChannels; ++i)
+            VectorOps::addReversedWithMultiply(dest[i] + done, delayBuffer.getReadPointer(i, readPos), window, num);
+
+        done += num;
+        head.phase += num;
+    }
+}
+
+void DigitalDelayAudioProcessor::readGrainsFromDelayBuffer(juce::AudioSampleBuffer& buffer, Bus& outputBus,
+    const StereoMatrix& startMatrix, const StereoMatrix& endMatrix,
+    const int delaySamples)
+{
+    const int numSamples = buffer.getNumSamples();
+    const int numChannels = juce::jmin(outputBus.getNumberOfChannels(), delayBuffer.getNumChannels());
+
+    kernelBuffer.setSize(numChannels, numSamples, false, false, true);
+    kernelBuffer.clear();
+    grainScheduler.process(delayBuffer, writePosition, delaySamples, kernelBuffer, numChannels, numSamples, grainSettings);
+
+    addFromKernelBuffer(buffer, outputBus, startMatrix, endMatrix);
+}
+
+void DigitalDelayAudioProcessor::addFromKernelBuffer(juce::AudioSampleBuffer& buffer, Bus& outputBus,
+    const StereoMatrix& startMatrix, const StereoMatrix& endMatrix)
+{
+    const int numChannels = juce::jmin(kernelBuffer.getNumChannels(), outputBus.getNumberOfChannels(), 2);
+    if (numChannels == 0)
+        return;
+
+    const bool stereo = numChannels > 1;
+    VectorOps::applyStereoMatrix(buffer.getWritePointer(outputBus.getChannelIndexInProcessBlockBuffer(0)),
+        stereo ? buffer.getWritePointer(outputBus.getChannelIndexInProcessBlockBuffer(1)) : nullptr,
+        kernelBuffer.getReadPointer(0), stereo ? kernelBuffer.getReadPointer(1) : nullptr,
+        kernelBuffer.getNumSamples(), startMatrix, endMatrix, true);
+}
+
+StereoMatrix DigitalDelayAudioProcessor::getWetMatrix() const noexcept
+{
+    if (ecoFadingOut)
+        return StereoMatrix::silence();
+
+    return StereoMatrix::fromWidthAndPan(dryWet, width, pan);
+}
+
+void DigitalDelayAudioProcessor::processFused(juce::AudioSampleBuffer& buffer,
+    const StereoMatrix& wetStartMatrix, const StereoMatrix& wetEndMatrix,
+    float dryStartGain, float dryEndGain,
+    float feedbackStartGain, float feedbackEndGain,
+    bool capturingWet)
+{
+    constexpr int chunkSize = ReadHeadPool::chunkSize;
+    const int numSamples = buffer.getNumSamples();
+    const int numChannels = delayBuffer.getNumChannels();
+    const int delayBufferSize = delayBuffer.getNumSamples();
+    const float dryStep = (dryEndGain - dryStartGain) / numSamples;
+    const float feedbackStep = (feedbackEndGain - feedbackStartGain) / numSamples;
+    float wetChunks[2][chunkSize];
+
+    // one chunk at a time: write the input, gather the delayed signal, mix the output and feed it back,
+    // all while the chunk of host buffer and delay line is still in cache
+    int writePos = writePosition;
+    for (int start = 0; start < numSamples; start += chunkSize)
+    {
+        const int num = juce::jmin(chunkSize, numSamples - start);
+        const int firstPart = juce::jmin(num, delayBufferSize - writePos);
+        readHeads.beginChunk(num);
+
+        for (int c = 0; c < numChannels; ++c)
+        {
+            float* io = buffer.getWritePointer(c, start);
+            float* delayData = delayBuffer.getWritePointer(c);
+
+            // the input goes in first so delays shorter than a chunk still find it
+            juce::FloatVectorOperations::copy(delayData + writePos, io, firstPart);
+            juce::FloatVectorOperations::copy(delayData, io + firstPart, num - firstPart);
+
+            readHeads.mixChunk(delayData, delayBufferSize, wetChunks[c]);
+        }
+
+        // level, pan and width need both channels at once, so they go on before either is mixed
+        float* wetRight = numChannels > 1 ? wetChunks[1] : nullptr;
+        VectorOps::applyStereoMatrix(wetChunks[0], wetRight, wetChunks[0], wetRight, num,
+            StereoMatrix::interpolate(wetStartMatrix, wetEndMatrix, float(start) / numSamples),
+            StereoMatrix::interpolate(wetStartMatrix, wetEndMatrix, float(start + num) / numSamples), false);
+
+        for (int c = 0; c < numChannels; ++c)
+        {
+            float* io = buffer.getWritePointer(c, start);
+            float* delayData = delayBuffer.getWritePointer(c);
+            const float* wet = wetChunks[c];
+
+            auto mixAndFeedBack = [&](int from, int to, float* delaySlots)
+            {
+                for (int i = from; i < to; ++i)
+                {
+                    const float n = float(start + i);
+                    const float out = (dryStartGain + dryStep * n) * io[i] + wet[i];
+                    io[i] = out;
+                    delaySlots[i - from] += (feedbackStartGain + feedbackStep * n) * out;
+                }
+            };
+            mixAndFeedBack(0, firstPart, delayData + writePos);
+            mixAndFeedBack(firstPart, num, delayData);
+
+            if (capturingWet)
+                juce::FloatVectorOperations::copy(wetBuffer.getWritePointer(c, start), wet, num);
+        }
+
+        readHeads.endChunk(delayBufferSize);
+        writePos += num;
+        if (writePos >= delayBufferSize)
+            writePos -= delayBufferSize;
+    }
+}
+
+//==============================================================================
+bool DigitalDelayAudioProcessor::hasEditor() const
+{
+    return true; // (change this to false if you choose to not supply an editor)
+}
+
+juce::AudioProcessorEditor* DigitalDelayAudioProcessor::createEditor()
+{
+    return new DigitalDelayAudioProcessorEditor (*this);
+}
+
+//==============================================================================
+void DigitalDelayAudioProcessor::getStateInformation(juce::MemoryBlock& destData)
+{
+    // a restore the audio thread hasn't taken yet is what the host last gave us, so it wins over the snapshot
+    const auto pendingRestore = pendingTimeRestore.load(std::memory_order_acquire);
+    const auto timeState = pendingRestore != 0 ? unpackTimeState((juce::uint32) pendingRestore) : getTimeState();
+    bool buttonStates[4] = { timeState.millisecondsActive, ! timeState.millisecondsActive,
+                             timeState.eighthTripletActive, ! timeState.eighthTripletActive };
+    auto state = tree.copyState();
+    juce::XmlElement* xmlParent = new juce::XmlElement("parent");
+    juce::XmlElement* xmlSteps  = xmlParent->createNewChildElement(getStepsParamName());
+    juce::XmlElement* xmlMsec   = xmlParent->createNewChildElement(getMsecParamName());
+    juce::XmlElement* xmlButtons = xmlParent->createNewChildElement(juce::String("buttonids"));
+    std::unique_ptr<juce::XmlElement> xml(state.createXml());
+
+    xmlParent->addChildElement(xml.release());
+    xmlSteps->setAttribute(juce::String("stepsval"), timeState.steps);
+    xmlMsec->setAttribute(juce::String("msecval"), timeState.msec);
+    
+    for (int i = 0; i < 4; ++i)
+    {
+        xmlButtons->setAttribute(buttonIDs[i], buttonStates[i]);
+    }
+    
+    copyXmlToBinary(*xmlParent, destData);
+    
+    delete xmlParent;
+}
+
+void DigitalDelayAudioProcessor::setStateInformation(const void* data, int sizeInBytes)
+{
+    bool buttonStates[4] = {false, true, false, true}; //these are set to the original defaults for use in getBoolAttribute
+    TimeState timeState = getTimeState();
+    std::unique_ptr<juce::XmlElement> xmlState(getXmlFromBinary(data, sizeInBytes));
+    juce::XmlElement* xmlTree = xmlState->getChildByName(tree.state.getType());
+    juce::XmlElement* xmlSteps = xmlState->getChildByName(getStepsParamName());
+    juce::XmlElement* xmlMsec = xmlState->getChildByName(getMsecParamName());
+    juce::XmlElement* xmlButtons = xmlState->getChildByName("buttonids");
+
+    if (xmlState.get() != nullptr)
+    {
+        if (xmlTree->hasTagName(tree.state.getType()))
+        {
+            tree.replaceState(juce::ValueTree::fromXml(*xmlTree));
+        }
+        if (xmlSteps->hasTagName(getStepsParamName()))
+        {
+            timeState.steps = xmlSteps->getIntAttribute(juce::String("stepsval"), 15);
+        }
+        if (xmlMsec->hasTagName(getMsecParamName()))
+        {
+            timeState.msec = xmlMsec->getIntAttribute(juce::String("msecval"), 130);
+        }
+        
+        if (xmlButtons->hasTagName(juce::String("buttonids")) && xmlButtons != nullptr)
+        {
+            for (int i = 0; i < 4; ++i)
+                buttonStates[i] = xmlButtons->getBoolAttribute(buttonIDs[i], buttonStates[i]);
+        }
+        timeState.millisecondsActive = buttonStates[0];
+        timeState.eighthTripletActive = buttonStates[2];
+
+        // taken by the audio thread at the start of its next block, or by prepareToPlay if it isn't running yet.
+        // The generation goes up only once the word is stored, so no command can be queued behind a restore it can't see
+        const auto packed = packTimeState(timeState);
+        const auto generation = timeRestoreGeneration.load() + 1;
+        pendingTimeRestore.store((juce::uint64) generation << 32 | packed, std::memory_order_release);
+        timeRestoreGeneration.store(generation);
+
+        // the editor shows the restored settings straight away rather than after the next block
+        publishedTimeState.store(packed, std::memory_order_relaxed);
+        timeStateVersion.fetch_add(1, std::memory_order_release);
+    }
+}
+
+//==============================================================================
+// This creates new instances of the plugin..
+juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
+{
+    return new DigitalDelayAudioProcessor();
+}
+
+const juce::String& DigitalDelayAudioProcessor::getFeedbackParamName()
+{
+    static const juce::String name("Feedback");
+    return name;
+}
+const juce::String& DigitalDelayAudioProcessor::getPanParamName()
+{
+    static const juce::String name("Pan");
+    return name;
+}
+const juce::String& DigitalDelayAudioProcessor::getWidthParamName()
+{
+    static const juce::String name("Width");
+    return name;
+}
+const juce::String& DigitalDelayAudioProcessor::getDryWetParamName()
+{
+    static const juce::String name("DryWet");
+    return name;
+}
+const juce::String& DigitalDelayAudioProcessor::getMsecParamName()
+{
+    static const juce::String name("Milliseconds");
+    return name;
+}
+const juce::String& DigitalDelayAudioProcessor::getStepsParamName()
+{
+    static const juce::String name("Steps");
+    return name;
+}
+const juce::String& DigitalDelayAudioProcessor::getSixteenthNoteParamName()
+{
+    static const juce::String name("Sixteenth");
+    return name;
+}
+const juce::String& DigitalDelayAudioProcessor::getEighthTripletParamName()
+{
+    static const juce::String name("EighthTriplet");
+    return name;
+}
+const juce::String& DigitalDelayAudioProcessor::getFreezeParamName()
+{
+    static const juce::String name("Freeze");
+    return name;
+}
+const juce::String& DigitalDelayAudioProcessor::getReverseParamName()
+{
+    static const juce::String name("Reverse");
+    return name;
+}
+const juce::String& DigitalDelayAudioProcessor::getGranularParamName()
+{
+    static const juce::String name("Granular");
+    return name;
+}
+const juce::String& DigitalDelayAudioProcessor::getGrainSizeParamName()
+{
+    static const juce::String name("GrainSize");
+    return name;
+}
+const juce::String& DigitalDelayAudioProcessor::getGrainDensityParamName()
+{
+    static const juce::String name("GrainDensity");
+    return name;
+}
+const juce::String& DigitalDelayAudioProcessor::getGrainPitchParamName()
+{
+    static const juce::String name("GrainPitch");
+    return name;
+}
+const juce::String& DigitalDelayAudioProcessor::getGrainJitterParamName()
+{
+    static const juce::String name("GrainJitter");
+    return name;
+}
+const juce::String& DigitalDelayAudioProcessor::getCrossfadeParamName()
+{
+    static const juce::String name("Crossfade");
+    return name;
+}
+const juce::String& DigitalDelayAudioProcessor::getBypassFeedsDelayParamName()
+{
+    static const juce::String name("BypassFeedsDelay");
+    return name;
+}
+
+const juce::String& DigitalDelayAudioProcessor::getEcoParamName()
+{
+    static const juce::String name("Eco");
+    return name;
+}
+const juce::String& DigitalDelayAudioProcessor::getSpectralParamName()
 {
-    return juce::String("Feedback");
+    static const juce::String name("Spectral");
+    return name;
 }
-juce::String DigitalDelayAudioProcessor::getPanParamName()
+const juce::String& DigitalDelayAudioProcessor::getSpectralSizeParamName()
 {
-    return juce::String("Pan");
+    static const juce::String name("SpectralSize");
+    return name;
 }
-juce::String DigitalDelayAudioProcessor::getDryWetParamName()
+const juce::String& DigitalDelayAudioProcessor::getSpectralTiltParamName()
 {
-    return juce::String("DryWet");
+    static const juce::String name("SpectralTilt");
+    return name;
 }
-juce::String DigitalDelayAudioProcessor::getMsecParamName()
+const juce::String& DigitalDelayAudioProcessor::getSpectralDampingParamName()
 {
-    return juce::String("Milliseconds");
+    static const juce::String name("SpectralDamping");
+    return name;
 }
-juce::String DigitalDelayAudioProcessor::getStepsParamName()
+const juce::String& DigitalDelayAudioProcessor::getDiffusionParamName()
 {
-    return juce::String("Steps");
+    static const juce::String name("Diffusion");
+    return name;
 }
-juce::String DigitalDelayAudioProcessor::getSixteenthNoteParamName()
+const juce::String& DigitalDelayAudioProcessor::getDiffusionStagesParamName()
 {
-    return juce::String("Sixteenth");
+    static const juce::String name("DiffusionStages");
+    return name;
 }
-juce::String DigitalDelayAudioProcessor::getEighthTripletParamName()
+const juce::String& DigitalDelayAudioProcessor::getDiffusionAmountParamName()
 {
-    return juce::String("EighthTriplet");
+    static const juce::String name("DiffusionAmount");
+    return name;
 }
 
 bool DigitalDelayAudioProcessor::isMillisecondsActive()
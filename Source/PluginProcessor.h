@@ -9,11 +9,21 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "WetCapture.h"
+#include "WindowTable.h"
+#include "GrainScheduler.h"
+#include "ReadHeadPool.h"
+#include "BandLimitedResampler.h"
+#include "HalfBandFilter.h"
+#include "SpectralDelay.h"
+#include "AllpassDiffuser.h"
+#include "StereoMatrix.h"
 
 //==============================================================================
 /**
 */
-class DigitalDelayAudioProcessor  : public juce::AudioProcessor, public juce::AudioProcessorValueTreeState::Listener
+class DigitalDelayAudioProcessor  : public juce::AudioProcessor, public juce::AudioProcessorValueTreeState::Listener,
+                                    private juce::Timer
 {
 public:
     //==============================================================================
@@ -29,6 +39,7 @@ public:
    #endif
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlockBypassed (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -54,13 +65,32 @@ public:
     void setStateInformation (const void* data, int sizeInBytes) override;
 
     //==============================================================================
-    juce::String getFeedbackParamName();
-    juce::String getPanParamName();
-    juce::String getDryWetParamName(); 
-    juce::String getMsecParamName();
-    juce::String getStepsParamName();
-    juce::String getSixteenthNoteParamName();
-    juce::String getEighthTripletParamName();
+    // built once, so parameterChanged can compare against them on the audio thread without allocating
+    const juce::String& getFeedbackParamName();
+    const juce::String& getPanParamName();
+    const juce::String& getWidthParamName();
+    const juce::String& getDryWetParamName(); 
+    const juce::String& getMsecParamName();
+    const juce::String& getStepsParamName();
+    const juce::String& getSixteenthNoteParamName();
+    const juce::String& getEighthTripletParamName();
+    const juce::String& getFreezeParamName();
+    const juce::String& getReverseParamName();
+    const juce::String& getGranularParamName();
+    const juce::String& getGrainSizeParamName();
+    const juce::String& getGrainDensityParamName();
+    const juce::String& getGrainPitchParamName();
+    const juce::String& getGrainJitterParamName();
+    const juce::String& getCrossfadeParamName();
+    const juce::String& getBypassFeedsDelayParamName();
+    const juce::String& getEcoParamName();
+    const juce::String& getSpectralParamName();
+    const juce::String& getSpectralSizeParamName();
+    const juce::String& getSpectralTiltParamName();
+    const juce::String& getSpectralDampingParamName();
+    const juce::String& getDiffusionParamName();
+    const juce::String& getDiffusionStagesParamName();
+    const juce::String& getDiffusionAmountParamName();
 
     bool isMillisecondsActive();
     bool isStepsActive();
@@ -90,6 +120,26 @@ public:
         float startGain, float endGain,
         bool replacing);
 
+    void readFromFrozenLoop(juce::AudioSampleBuffer& buffer, Bus& outputBus,
+        const StereoMatrix& startMatrix, const StereoMatrix& endMatrix);
+
+    void readReversedFromDelayBuffer(juce::AudioSampleBuffer& buffer, Bus& outputBus,
+        const StereoMatrix& startMatrix, const StereoMatrix& endMatrix,
+        const int segmentLength);
+
+    void readGrainsFromDelayBuffer(juce::AudioSampleBuffer& buffer, Bus& outputBus,
+        const StereoMatrix& startMatrix, const StereoMatrix& endMatrix,
+        const int delaySamples);
+
+    void processFused(juce::AudioSampleBuffer& buffer,
+        const StereoMatrix& wetStartMatrix, const StereoMatrix& wetEndMatrix,
+        float dryStartGain, float dryEndGain,
+        float feedbackStartGain, float feedbackEndGain,
+        bool capturingWet);
+
+    // the fused kernel can be switched off to compare it against the separate stages
+    void setFusedProcessingEnabled(bool shouldBeEnabled) { fusedProcessingEnabled = shouldBeEnabled; }
+
     //juce::ValueTree valueTree;
     juce::AudioProcessorValueTreeState tree;
     juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
@@ -97,13 +147,183 @@ public:
 
     void convertStepsToMsec();
 
+    WetCapture& getWetCapture() { return wetCapture; }
+    int getNumActiveGrains() const { return grainScheduler.getNumActiveGrains(); }
+
+    // what eco mode saves against running the delay line at the host rate
+    struct EcoStats
+    {
+        int factor{ 1 };
+        size_t delayLineBytes{ 0 };
+        size_t delayLineBytesSaved{ 0 };
+        double delayRateFraction{ 1.0 };  // of the host rate, the CPU it saves is measured by BatchRenderer --bench
+    };
+    EcoStats getEcoStats() const;
+
     int   msec;
     int   steps;
     juce::Value steps2;
+
+    static constexpr int maxSteps = 16;
+    static constexpr int maxMilliseconds = 2000;
+
+    // the editor never writes the time settings itself: it queues commands that processBlock applies
+    // before anything else, and polls a snapshot whose version changes whenever the settings do.
+    // A restored state doesn't queue, it waits in a word of its own that processBlock takes first
+    enum class TimeCommand
+    {
+        useMilliseconds,
+        useSteps,
+        useSixteenthNotes,
+        useEighthTriplets,
+        setValue,    // steps or milliseconds, whichever is active
+        nudgeValue
+    };
+    bool pushTimeCommand(TimeCommand command, int value = 0);  // editor only, false if the queue is full
+
+    struct TimeState
+    {
+        int  msec{ 0 };
+        int  steps{ 1 };
+        bool millisecondsActive{ false };
+        bool eighthTripletActive{ false };
+    };
+    juce::uint32 getTimeStateVersion() const noexcept { return timeStateVersion.load(std::memory_order_acquire); }
+    TimeState getTimeState() const noexcept;
+
 private:
     juce::AudioBuffer<float> delayBuffer;
-    int expectedReadPos{ -1 };
+    EqualPowerTable equalPowerTable;  // the read head crossfades and the freeze loop share it
+    ReadHeadPool readHeads{ equalPowerTable };
+
+    // keeps the delayed tail when the host re-prepares, resampling it if the sample rate changed
+    void resizeDelayBuffer(int numChannels, int minimumSize, double oldSampleRate, double newSampleRate);
+    juce::AudioBuffer<float> resampleBuffer;
+    BandLimitedResampler tailResampler;
+    int fullRateDelayBufferSize{ 0 };
+
+    // what delayBuffer's allocation is known to hold, so prepareToPlay only grows it when it's actually short
+    void reserveDelayBuffer(int numChannels, int numSamples);
+    int delayBufferReservedChannels{ 0 };
+    int delayBufferReservedSamples{ 0 };
+
+    // eco runs the delay engine at a half or a quarter of the host rate, with half-band stages either side
+    static constexpr int maxEcoStages = 2;
+    static constexpr int maxEcoChannels = 2;
+    void updateEcoFactor(bool wetAudible);
+    void setEcoFactor(int newFactor);
+    void resetEcoFilters();
+    void processAtDelayRate(juce::AudioSampleBuffer& buffer);
+
+    // MIDI: notes from midiDivisionBaseNote up pick the number of steps, midiTapNote taps the tempo
+    // and MIDI clock sets the tempo when the host has none. Times are in samples since prepareToPlay
+    static constexpr int midiTapNote = 35;
+    static constexpr int midiDivisionBaseNote = 36;
+    static constexpr int clocksPerBeat = 24;
+    void processWithMidi(juce::AudioSampleBuffer& buffer, const juce::MidiBuffer& midiMessages);
+    bool movesDelay(const juce::MidiMessage& message) const;
+    void handleMidiEvent(const juce::MidiMessage& message, juce::int64 time);
+    juce::int64 midiTime{ 0 };
+    juce::int64 clockTickTimes[clocksPerBeat]{};
+    int clockTickIndex{ 0 };
+    int numClockTicks { 0 };
+    double midiClockTempo{ 0.0 };
+    juce::int64 lastTapTime{ -1 };
+    double tapTempo{ 0.0 };
+    void processDecimated(juce::AudioSampleBuffer& buffer);
+    int decimateInput(const juce::AudioSampleBuffer& buffer);
+    int ecoFactor   { 1 };
+    int ecoRequested{ 1 };
+    bool ecoFadingOut{ false };  // the wet fades out over the block before a switch
+    float delaySampleRate{ 44100.0f };
+    HalfBandFilter inputDecimators[maxEcoChannels][maxEcoStages];
+    HalfBandFilter wetInterpolators[maxEcoChannels][maxEcoStages];
+    float wetCarry[maxEcoChannels][1 << maxEcoStages];
+    int numWetCarry{ 0 };
+    juce::AudioBuffer<float> ecoBuffer;
+    juce::AudioBuffer<float> ecoDryBuffer;
+    juce::AudioBuffer<float> ecoStageBuffer;
+    juce::AudioBuffer<float> ecoWetBuffer;
+    bool fusedProcessingEnabled{ true };
+
+    void processDelay(juce::AudioSampleBuffer& buffer);
+    void updateTempo();
+
+    // the spectral delay runs at the host rate beside the time domain engine and adds one FFT size of latency.
+    // Freeze, reverse and granular read the time domain delay line, so they wait until spectral is off again
+    void processSpectral(juce::AudioSampleBuffer& buffer);
+    void writeAtDelayRate(const juce::AudioSampleBuffer& buffer, bool feedInput);
+    SpectralDelay spectralDelay;
+    SpectralDelay::Settings spectralSettings;
+    bool spectralRequested{ false };
+    bool spectralActive   { false };
+    int spectralOrderRequested{ 10 };
+    juce::AudioBuffer<float> spectralScratch;
+    juce::AudioBuffer<float> spectralScratchWet;
+    juce::AudioBuffer<float> spectralDryBuffer;
+    juce::AudioBuffer<float> spectralWetBuffer;
+    AllpassDiffuser spectralDiffuser;  // the spectral wet is at the host rate, the delay line may not be
+
+    // setLatencySamples() locks and calls the host, so parameterChanged only leaves the new value for the timer
+    void timerCallback() override;
+    std::atomic<int> pendingLatency{ 0 };
+
+    // while bypassed the host still compensates for the latency, so the dry signal comes out as late
+    void delayDryByLatency(juce::AudioSampleBuffer& buffer, bool replaceWithDelayed);
+    juce::AudioBuffer<float> latencyBuffer;
+    int latencyWritePosition{ 0 };
+    int dryLatency{ 0 };
+
+    // the time domain pass under a spectral crossfade hands its wet over, so each block is captured once
+    void captureWet(const juce::AudioSampleBuffer& wet, int numSamples);
+    bool holdingCapturedWet{ false };
+
+    // allpass diffusion on the wet signal or inside the feedback loop, the fused kernel is skipped while it's on
+    enum class DiffusionPlacement
+    {
+        off,
+        wet,
+        feedback
+    };
+    void diffuse(juce::AudioSampleBuffer& buffer, Bus& bus);
+    void updateDiffusionStages();
+    DiffusionPlacement diffusionPlacement{ DiffusionPlacement::off };
+    int diffusionStagesRequested{ 4 };  // taken on at the start of a block
+    AllpassDiffuser diffuser;
+    juce::AudioBuffer<float> diffusionBuffer;
+
+    // the editor on the message thread is the only writer and the audio thread the only reader,
+    // so the fifo is wait-free at both ends
+    struct QueuedTimeCommand
+    {
+        TimeCommand command;
+        int value;
+        juce::uint32 restoreGeneration;  // commands queued before a restore are overtaken by it
+    };
+    static constexpr int timeCommandQueueSize = 64;
+    QueuedTimeCommand timeCommands[timeCommandQueueSize];
+    juce::AbstractFifo timeCommandFifo{ timeCommandQueueSize };
+    void applyTimeCommands();
+    void applyTimeCommand(const QueuedTimeCommand& queued);
+    void takePendingTimeRestore();
+    void publishTimeState();
+    static juce::uint32 packTimeState(const TimeState& state) noexcept;
+    static TimeState unpackTimeState(juce::uint32 packed) noexcept;
+    std::atomic<juce::uint32> publishedTimeState{ 0 };
+    std::atomic<juce::uint32> timeStateVersion{ 0 };
+
+    // restore generation in the top half and the packed TimeState below it, zero when nothing is pending
+    std::atomic<juce::uint64> pendingTimeRestore{ 0 };
+    std::atomic<juce::uint32> timeRestoreGeneration{ 0 };
+    juce::uint32 appliedRestoreGeneration{ 0 };
+
+    // while bypassed the delay line keeps rolling with silence, or the input when feedInput is set
+    void writeBypassedToDelayBuffer(const juce::AudioSampleBuffer& buffer, bool feedInput);
+    bool bypassed        { false };
+    bool bypassFeedsDelay{ false };
     juce::AudioBuffer<float> dryBuffer;
+    juce::AudioBuffer<float> wetBuffer;
+    WetCapture wetCapture;
     juce::AudioPlayHead* playHead;
     juce::AudioPlayHead::CurrentPositionInfo sessionInfo;
 
@@ -122,9 +342,59 @@ private:
     float lastDryWet;
     float dryGain;
     float lastDryGain;
-    float pan; //can probably remove
-    float panGains[2]{ 1.0f,1.0f };
-    float lastPanGains[2]{ 1.0f,1.0f };
+    float pan;
+    float width{ 1.0f };
+
+    // dry/wet, pan and mid/side width as one matrix on the wet signal, ramped from where the last block ended
+    StereoMatrix getWetMatrix() const noexcept;
+    StereoMatrix lastWetMatrix{ StereoMatrix::silence() };
+
+    // freeze loops [freezeStart, freezeStart + freezeLength) of delayBuffer without writing to it
+    void startFreeze(int loopLength);
+    void releaseFreeze();
+    bool freezeRequested { false };
+    bool frozen          { false };
+    int  freezeStart     { 0 };
+    int  freezeLength    { 1 };
+    int  freezeFadeLength{ 0 };
+    int  freezePhase     { 0 };
+    int  loopFadeLength  { 1 };  // the loop fades in at a freeze and out after the release, across blocks
+    int  loopFadePos     { 0 };
+
+    // the delayed signal is read forwards, in reverse or as grains
+    enum class ReadMode
+    {
+        forward,
+        reverse,
+        granular
+    };
+    ReadMode readMode{ ReadMode::forward };
+    void addFromKernelBuffer(juce::AudioSampleBuffer& buffer, Bus& outputBus,
+        const StereoMatrix& startMatrix, const StereoMatrix& endMatrix);
+    juce::AudioBuffer<float> kernelBuffer;
+
+    // reverse plays each segment of the delay line backwards, two Hann windowed heads half a segment apart.
+    // Both share one segment length, so the windows always sum to one
+    struct ReverseHead
+    {
+        int anchor{ 0 };  // newest sample of the segment, read first
+        int phase { 0 };
+    };
+    void startReverse(int segmentLength);
+    int getReverseLength(int segmentLength) const;
+    void readReverseHead(ReverseHead& head, float* const* dest, int numChannels, int numSamples);
+    void buildReverseWindow();
+    ReverseHead reverseHeads[2];
+    int reverseLength{ 2 };
+    bool reverseRequested{ false };
+    juce::AudioBuffer<float> reverseWindow;  // one whole segment's window, rebuilt when the length changes
+    int reverseWindowLength{ 0 };
+    WindowTable windowTable;
+
+    // granular reads short windowed grains from the delay line, pitched and scattered
+    GrainScheduler grainScheduler{ windowTable };
+    GrainScheduler::Settings grainSettings;
+    bool granularRequested{ false };
 
     juce::StringArray buttonIDs;
 
@@ -0,0 +1,209 @@
+/*
+  ==============================================================================
+
+    ReadHeadPool.cpp
+
+  ==============================================================================
+*/
+
+#include "ReadHeadPool.h"
+
+ReadHeadPool::ReadHeadPool(const EqualPowerTable& fadeToUse)
+    : fade(fadeToUse)
+{
+}
+
+void ReadHeadPool::prepare(double newSampleRate)
+{
+    sampleRate = newSampleRate;
+    setFadeLength(fadeSeconds);
+    reset();
+}
+
+void ReadHeadPool::reset()
+{
+    for (auto& head : heads)
+        head.state = HeadState::idle;
+    mainHead = -1;
+}
+
+void ReadHeadPool::setFadeLength(double seconds)
+{
+    fadeSeconds = seconds;
+    fadeLength = juce::jmax(1, juce::roundToInt(seconds * sampleRate));
+}
+
+bool ReadHeadPool::isPlaying() const noexcept
+{
+    for (auto& head : heads)
+        if (head.state != HeadState::idle)
+            return true;
+    return false;
+}
+
+void ReadHeadPool::fadeOutAll()
+{
+    for (auto& head : heads)
+    {
+        if (head.state == HeadState::steady)
+        {
+            head.state = HeadState::fadingOut;
+            head.fadePos = 0;
+        }
+        else if (head.state == HeadState::fadingIn)
+        {
+            // pick up the fade out at the gain the fade in had reached
+            head.state = HeadState::fadingOut;
+            head.fadePos = fadeLength - juce::jmin(head.fadePos, fadeLength);
+        }
+    }
+    mainHead = -1;
+}
+
+float ReadHeadPool::handOverMainHead(int readPos) noexcept
+{
+    float proportion = 0.0f;
+    if (mainHead >= 0 && heads[mainHead].position == readPos)
+    {
+        auto& head = heads[mainHead];
+        proportion = head.state == HeadState::fadingIn ? juce::jmin(1.0f, (float) head.fadePos / fadeLength) : 1.0f;
+        head.state = HeadState::idle;
+    }
+
+    fadeOutAll();
+    return proportion;
+}
+
+int ReadHeadPool::findHeadToStart() const noexcept
+{
+    int quietest = -1;
+    for (int i = 0; i < maxHeads; ++i)
+    {
+        if (heads[i].state == HeadState::idle)
+            return i;
+
+        // all busy: take over the fading out head that is furthest through its fade
+        if (heads[i].state == HeadState::fadingOut && (quietest < 0 || heads[i].fadePos > heads[quietest].fadePos))
+            quietest = i;
+    }
+    return quietest;
+}
+
+void ReadHeadPool::retarget(int readPos)
+{
+    if (mainHead >= 0 && heads[mainHead].position == readPos)
+        return;
+
+    fadeOutAll();
+
+    const int index = findHeadToStart();
+    if (index < 0)
+        return;
+
+    auto& head = heads[index];
+    head.state = HeadState::fadingIn;
+    head.position = readPos;
+    head.fadePos = 0;
+    mainHead = index;
+}
+
+void ReadHeadPool::fillGains(const Head& head, float* gains, int num) const noexcept
+{
+    // quarter sine, sin(x)^2 + cos(x)^2 = 1 keeps the power constant through the fade
+    const double scale = 1.0 / fadeLength;
+
+    if (head.state == HeadState::fadingIn)
+        fade.fill(gains, head.fadePos * scale, scale, num);
+    else if (head.state == HeadState::fadingOut)
+        fade.fill(gains, 1.0 - head.fadePos * scale, -scale, num);
+    else
+        juce::FloatVectorOperations::fill(gains, 1.0f, num);
+}
+
+void ReadHeadPool::advance(Head& head, int num, int delayLineSize) noexcept
+{
+    head.position += num;
+    if (head.position >= delayLineSize)
+        head.position -= delayLineSize;
+
+    if (head.state == HeadState::fadingIn || head.state == HeadState::fadingOut)
+    {
+        head.fadePos += num;
+        if (head.fadePos >= fadeLength)
+            head.state = (head.state == HeadState::fadingIn) ? HeadState::steady : HeadState::idle;
+    }
+}
+
+void ReadHeadPool::process(const juce::AudioBuffer<float>& delayLine, juce::AudioBuffer<float>& output,
+    const int* outputChannels, int numChannels, int numSamples,
+    const StereoMatrix& start, const StereoMatrix& end)
+{
+    const int delayLineSize = delayLine.getNumSamples();
+    numChannels = juce::jmin(numChannels, delayLine.getNumChannels(), 2);
+    if (numChannels == 0)
+        return;
+
+    float mix[2][chunkSize];
+
+    // chunks are small enough to stay in cache, so the output and the delay line are only streamed through once
+    for (int done = 0; done < numSamples; done += chunkSize)
+    {
+        const int num = juce::jmin(chunkSize, numSamples - done);
+
+        beginChunk(num);
+        if (numPlaying == 0)
+            break;
+
+        for (int c = 0; c < numChannels; ++c)
+            mixChunk(delayLine.getReadPointer(c), delayLineSize, mix[c]);
+
+        // both channels go through the matrix together, width and pan cost no extra pass
+        const bool stereo = numChannels > 1;
+        VectorOps::applyStereoMatrix(output.getWritePointer(outputChannels[0], done),
+            stereo ? output.getWritePointer(outputChannels[1], done) : nullptr,
+            mix[0], stereo ? mix[1] : nullptr, num,
+            StereoMatrix::interpolate(start, end, float(done) / numSamples),
+            StereoMatrix::interpolate(start, end, float(done + num) / numSamples), true);
+
+        endChunk(delayLineSize);
+    }
+}
+
+void ReadHeadPool::beginChunk(int num) noexcept
+{
+    jassert(num <= chunkSize);
+    chunkLength = num;
+    numPlaying = 0;
+
+    for (int h = 0; h < maxHeads; ++h)
+    {
+        if (heads[h].state == HeadState::idle)
+            continue;
+
+        fillGains(heads[h], headGains[numPlaying], num);
+        playing[numPlaying++] = h;
+    }
+}
+
+void ReadHeadPool::mixChunk(const float* delayData, int delayLineSize, float* mix) const noexcept
+{
+    juce::FloatVectorOperations::clear(mix, chunkLength);
+
+    for (int p = 0; p < numPlaying; ++p)
+    {
+        const int position = heads[playing[p]].position;
+        const int firstPart = juce::jmin(chunkLength, delayLineSize - position);
+        juce::FloatVectorOperations::addWithMultiply(mix, delayData + position, headGains[p], firstPart);
+        if (firstPart < chunkLength)
+            juce::FloatVectorOperations::addWithMultiply(mix + firstPart, delayData, headGains[p] + firstPart, chunkLength - firstPart);
+    }
+}
+
+void ReadHeadPool::endChunk(int delayLineSize) noexcept
+{
+    for (int p = 0; p < numPlaying; ++p)
+        advance(heads[playing[p]], chunkLength, delayLineSize);
+
+    if (mainHead >= 0 && heads[mainHead].state == HeadState::idle)
+        mainHead = -1;
+}
@@ -0,0 +1,104 @@
+/*
+  ==============================================================================
+
+    ReadHeadPool.h
+
+    Forward read of the delay line with equal power crossfades whenever the
+    read position jumps.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "StereoMatrix.h"
+#include "WindowTable.h"
+
+//==============================================================================
+/**
+    Every jump of the read position starts a new head that fades in while the
+    old one fades out. The fade length is set in seconds, so it doesn't depend on
+    the host block size, and fades carry on across block boundaries. A few heads
+    can be fading at once, so quick successive changes don't cut off the head that
+    is still fading. All heads are mixed in a single pass over the output.
+*/
+class ReadHeadPool
+{
+public:
+    static constexpr int maxHeads = 4;
+    static constexpr int chunkSize = 64;
+
+    explicit ReadHeadPool(const EqualPowerTable& fadeToUse);
+
+    void prepare(double sampleRate);
+    void reset();
+    void setFadeLength(double seconds);
+
+    /** Makes readPos the position of the main head. Nothing happens if the main head
+        is already there, otherwise it starts fading out and a new head fades in.
+    */
+    void retarget(int readPos);
+
+    // fades out every head, e.g. when another read mode takes over
+    void fadeOutAll();
+
+    /** For a read that carries on from readPos and takes over the main head's gain: the
+        main head stops without a fade if it is at readPos, and the rest fade out. Returns
+        how far the main head had faded in, 1 once steady and 0 if it wasn't there.
+    */
+    float handOverMainHead(int readPos) noexcept;
+    int getFadeLength() const noexcept { return fadeLength; }
+
+    bool isPlaying() const noexcept;
+
+    /** Adds numSamples of the delayed signal into output. Channel i of the delay
+        line goes to output channel outputChannels[i], through the wet matrix ramping
+        from start to end. The heads advance by numSamples.
+    */
+    void process(const juce::AudioBuffer<float>& delayLine, juce::AudioBuffer<float>& output,
+        const int* outputChannels, int numChannels, int numSamples,
+        const StereoMatrix& start, const StereoMatrix& end);
+
+    /** Chunk by chunk access for kernels that do more per sample than read.
+        beginChunk works out the head gains for the next num (<= chunkSize) samples,
+        mixChunk sums the heads for one channel and endChunk moves them on.
+    */
+    void beginChunk(int num) noexcept;
+    void mixChunk(const float* delayData, int delayLineSize, float* mix) const noexcept;
+    void endChunk(int delayLineSize) noexcept;
+    int  getNumPlayingInChunk() const noexcept { return numPlaying; }
+
+private:
+    enum class HeadState
+    {
+        idle,
+        steady,
+        fadingIn,
+        fadingOut
+    };
+
+    struct Head
+    {
+        HeadState state{ HeadState::idle };
+        int position{ 0 };
+        int fadePos { 0 };
+    };
+
+    void  fillGains(const Head& head, float* gains, int num) const noexcept;
+    void  advance(Head& head, int num, int delayLineSize) noexcept;
+    int   findHeadToStart() const noexcept;
+
+    Head  heads[maxHeads];
+    float headGains[maxHeads][chunkSize];
+    int   playing[maxHeads];
+    int   numPlaying{ 0 };
+    int   chunkLength{ 0 };
+    int   mainHead{ -1 };
+    int   fadeLength{ 1 };
+    const EqualPowerTable& fade;
+    double sampleRate{ 44100.0 };
+    double fadeSeconds{ 0.02 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ReadHeadPool)
+};
@@ -0,0 +1,293 @@
+/*
+  ==============================================================================
+
+    RealtimeSafetyChecker.cpp
+
+  ==============================================================================
+*/
+
+#include "RealtimeSafetyChecker.h"
+
+#if DIGITALDELAY_REALTIME_CHECKS
+
+#include <cerrno>
+#include <cstring>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
+
+// glibc's own allocator entry points, so the replacements below don't need dlsym
+extern "C" void* __libc_malloc(size_t);
+extern "C" void* __libc_calloc(size_t, size_t);
+extern "C" void* __libc_realloc(void*, size_t);
+extern "C" void* __libc_memalign(size_t, size_t);
+extern "C" void  __libc_free(void*);
+
+namespace RealtimeSafetyChecker
+{
+    namespace
+    {
+        constexpr int maxRecords = 256;
+        constexpr int maxFrames = 32;
+        constexpr int numHookFrames = 2;  // record() and the replaced function
+
+        struct Record
+        {
+            Violation type;
+            const char* function;
+            int numFrames;
+            void* frames[maxFrames];
+        };
+
+        // static storage, recording must not allocate
+        Record records[maxRecords];
+        std::atomic<int> numViolations{ 0 };
+
+        thread_local int audioScopeDepth = 0;
+        thread_local bool recording = false;
+
+        void record(Violation type, const char* function) noexcept
+        {
+            // backtrace() and the real functions can come back through the hooks
+            if (audioScopeDepth == 0 || recording)
+                return;
+
+            recording = true;
+            const int index = numViolations.fetch_add(1);
+            if (index < maxRecords)
+            {
+                auto& r = records[index];
+                r.type = type;
+                r.function = function;
+                r.numFrames = backtrace(r.frames, maxFrames);
+            }
+            recording = false;
+        }
+
+        const char* getDescription(Violation type) noexcept
+        {
+            switch (type)
+            {
+                case Violation::allocation:   return "allocation";
+                case Violation::deallocation: return "deallocation";
+                case Violation::lock:         return "lock";
+                case Violation::systemCall:   return "system call";
+            }
+            return "";
+        }
+
+        bool isSameStack(const Record& a, const Record& b) noexcept
+        {
+            return a.type == b.type && a.numFrames == b.numFrames
+                && std::memcmp(a.frames, b.frames, sizeof(void*) * (size_t) a.numFrames) == 0;
+        }
+
+        //==============================================================================
+        // the real functions, looked up before main() so the audio thread never runs dlsym
+        int (*realMutexLock) (pthread_mutex_t*);
+        int (*realRwlockRdlock) (pthread_rwlock_t*);
+        int (*realRwlockWrlock) (pthread_rwlock_t*);
+        int (*realCondWait) (pthread_cond_t*, pthread_mutex_t*);
+        int (*realCondTimedwait) (pthread_cond_t*, pthread_mutex_t*, const struct timespec*);
+        int (*realSemWait) (sem_t*);
+        int (*realNanosleep) (const struct timespec*, struct timespec*);
+        int (*realUsleep) (useconds_t);
+        ssize_t (*realRead) (int, void*, size_t);
+        ssize_t (*realWrite) (int, const void*, size_t);
+
+        template <typename Function>
+        void findNext(Function& function, const char* name) noexcept
+        {
+            function = reinterpret_cast<Function>(dlsym(RTLD_NEXT, name));
+        }
+
+        // runs ahead of the C++ static initialisers, some of which already lock
+        __attribute__((constructor(101))) void findRealFunctions() noexcept
+        {
+            findNext(realMutexLock, "pthread_mutex_lock");
+            findNext(realRwlockRdlock, "pthread_rwlock_rdlock");
+            findNext(realRwlockWrlock, "pthread_rwlock_wrlock");
+            findNext(realCondWait, "pthread_cond_wait");
+            findNext(realCondTimedwait, "pthread_cond_timedwait");
+            findNext(realSemWait, "sem_wait");
+            findNext(realNanosleep, "nanosleep");
+            findNext(realUsleep, "usleep");
+            findNext(realRead, "read");
+            findNext(realWrite, "write");
+
+            // the first backtrace() loads the unwinder, which allocates
+            void* frames[maxFrames];
+            backtrace(frames, maxFrames);
+        }
+    }
+
+    //==============================================================================
+    ScopedAudioThread::ScopedAudioThread() noexcept  { ++audioScopeDepth; }
+    ScopedAudioThread::~ScopedAudioThread() noexcept { --audioScopeDepth; }
+
+    int getNumViolations() noexcept
+    {
+        return numViolations.load();
+    }
+
+    void report(std::ostream& out)
+    {
+        const int total = numViolations.load();
+        const int numRecorded = juce::jmin(total, maxRecords);
+        std::vector<bool> reported((size_t) numRecorded, false);
+
+        for (int i = 0; i < numRecorded; ++i)
+        {
+            if (reported[(size_t) i])
+                continue;
+
+            int count = 0;
+            for (int j = i; j < numRecorded; ++j)
+            {
+                if (! reported[(size_t) j] && isSameStack(records[i], records[j]))
+                {
+                    reported[(size_t) j] = true;
+                    ++count;
+                }
+            }
+
+            const auto& r = records[i];
+            out << count << " x " << getDescription(r.type) << " (" << r.function << ") on the audio thread" << std::endl;
+
+            if (char** symbols = backtrace_symbols(r.frames, r.numFrames))
+            {
+                for (int f = numHookFrames; f < r.numFrames; ++f)
+                    out << "    " << symbols[f] << std::endl;
+                free(symbols);
+            }
+        }
+
+        if (total > numRecorded)
+            out << total - numRecorded << " more not recorded, the log was full" << std::endl;
+
+        numViolations = 0;
+    }
+}
+
+//==============================================================================
+using namespace RealtimeSafetyChecker;
+
+extern "C"
+{
+    void* malloc(size_t size)
+    {
+        record(Violation::allocation, "malloc");
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t num, size_t size)
+    {
+        record(Violation::allocation, "calloc");
+        return __libc_calloc(num, size);
+    }
+
+    void* realloc(void* ptr, size_t size)
+    {
+        record(Violation::allocation, "realloc");
+        return __libc_realloc(ptr, size);
+    }
+
+    void* memalign(size_t alignment, size_t size)
+    {
+        record(Violation::allocation, "memalign");
+        return __libc_memalign(alignment, size);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size)
+    {
+        record(Violation::allocation, "aligned_alloc");
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** result, size_t alignment, size_t size)
+    {
+        record(Violation::allocation, "posix_memalign");
+        *result = __libc_memalign(alignment, size);
+        return *result != nullptr || size == 0 ? 0 : ENOMEM;
+    }
+
+    void free(void* ptr)
+    {
+        if (ptr != nullptr)
+            record(Violation::deallocation, "free");
+        __libc_free(ptr);
+    }
+
+    int pthread_mutex_lock(pthread_mutex_t* mutex)
+    {
+        record(Violation::lock, "pthread_mutex_lock");
+        return realMutexLock(mutex);
+    }
+
+    int pthread_rwlock_rdlock(pthread_rwlock_t* lock)
+    {
+        record(Violation::lock, "pthread_rwlock_rdlock");
+        return realRwlockRdlock(lock);
+    }
+
+    int pthread_rwlock_wrlock(pthread_rwlock_t* lock)
+    {
+        record(Violation::lock, "pthread_rwlock_wrlock");
+        return realRwlockWrlock(lock);
+    }
+
+    int pthread_cond_wait(pthread_cond_t* condition, pthread_mutex_t* mutex)
+    {
+        record(Violation::lock, "pthread_cond_wait");
+        return realCondWait(condition, mutex);
+    }
+
+    int pthread_cond_timedwait(pthread_cond_t* condition, pthread_mutex_t* mutex, const struct timespec* time)
+    {
+        record(Violation::lock, "pthread_cond_timedwait");
+        return realCondTimedwait(condition, mutex, time);
+    }
+
+    int sem_wait(sem_t* semaphore)
+    {
+        record(Violation::lock, "sem_wait");
+        return realSemWait(semaphore);
+    }
+
+    int nanosleep(const struct timespec* duration, struct timespec* remaining)
+    {
+        record(Violation::systemCall, "nanosleep");
+        return realNanosleep(duration, remaining);
+    }
+
+    int usleep(useconds_t microseconds)
+    {
+        record(Violation::systemCall, "usleep");
+        return realUsleep(microseconds);
+    }
+
+    ssize_t read(int fd, void* data, size_t size)
+    {
+        record(Violation::systemCall, "read");
+        return realRead(fd, data, size);
+    }
+
+    ssize_t write(int fd, const void* data, size_t size)
+    {
+        record(Violation::systemCall, "write");
+        return realWrite(fd, data, size);
+    }
+}
+
+#else
+
+namespace RealtimeSafetyChecker
+{
+    int getNumViolations() noexcept  { return 0; }
+    void report(std::ostream&)       {}
+}
+
+#endif
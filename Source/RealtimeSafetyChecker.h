@@ -0,0 +1,68 @@
+/*
+  ==============================================================================
+
+    RealtimeSafetyChecker.h
+
+    Diagnostics build mode that traps allocations, locks and blocking system
+    calls made on the audio thread. Build with DIGITALDELAY_REALTIME_CHECKS=1
+    on Linux to enable it, otherwise everything here compiles away.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#ifndef DIGITALDELAY_REALTIME_CHECKS
+ #define DIGITALDELAY_REALTIME_CHECKS 0
+#endif
+
+#if DIGITALDELAY_REALTIME_CHECKS && ! JUCE_LINUX
+ #error "The realtime safety checks interpose libc functions and only work on Linux"
+#endif
+
+//==============================================================================
+/**
+    With the checks on, malloc/free, the pthread locks and a handful of blocking
+    system calls are replaced for the whole program. Calls made while a
+    ScopedAudioThread is alive on the calling thread are recorded with their
+    stack into a preallocated log, and report() prints them afterwards.
+
+    The replacements have to live in the executable to take precedence, so this
+    is meant for the BatchRenderer, not for the plugin loaded by a host.
+*/
+namespace RealtimeSafetyChecker
+{
+    enum class Violation
+    {
+        allocation,
+        deallocation,
+        lock,
+        systemCall
+    };
+
+    // marks the calling thread as the audio thread while it is alive, scopes can nest
+    class ScopedAudioThread
+    {
+    public:
+       #if DIGITALDELAY_REALTIME_CHECKS
+        ScopedAudioThread() noexcept;
+        ~ScopedAudioThread() noexcept;
+       #else
+        ScopedAudioThread() noexcept {}
+       #endif
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedAudioThread)
+    };
+
+    constexpr bool isEnabled() noexcept { return DIGITALDELAY_REALTIME_CHECKS != 0; }
+
+    // everything caught so far, including what didn't fit in the log
+    int getNumViolations() noexcept;
+
+    /** Prints each distinct offending stack with how often it was hit, then clears
+        the log. Allocates, so call it once the audio threads are done.
+    */
+    void report(std::ostream& out);
+}
@@ -0,0 +1,189 @@
+/*
+  ==============================================================================
+
+    SpectralDelay.cpp
+
+  ==============================================================================
+*/
+
+#include "SpectralDelay.h"
+
+namespace
+{
+    constexpr size_t historyAlignment = 64;
+
+    // Hann squared sums to 1.5 at a hop of a quarter window
+    constexpr float overlapGain = 1.0f / 1.5f;
+}
+
+int SpectralDelay::getHistoryStride(int fftOrder)
+{
+    const int numBins = (1 << fftOrder) / 2 + 1;
+    return 2 * binsPerBand * ((numBins + binsPerBand - 1) / binsPerBand);
+}
+
+int SpectralDelay::getNumFrames(int fftOrder, double rate)
+{
+    // two seconds of hops plus the frame being written
+    const int hop = (1 << fftOrder) / 4;
+    return (int) std::ceil(2.0 * rate / hop) + 2;
+}
+
+void SpectralDelay::prepare(int numChannels, double newSampleRate)
+{
+    sampleRate = newSampleRate;
+    numPreparedChannels = juce::jmin(numChannels, maxChannels);
+    const int maxSize = 1 << maxOrder;
+
+    for (int o = minOrder; o <= maxOrder; ++o)
+    {
+        const int size = 1 << o;
+        if (ffts[o - minOrder] == nullptr)
+            ffts[o - minOrder] = std::make_unique<juce::dsp::FFT>(o);
+
+        auto& window = windows[o - minOrder];
+        window.resize((size_t) size);
+        for (int i = 0; i < size; ++i)
+            window[(size_t) i] = 0.5f - 0.5f * std::cos(juce::MathConstants<float>::twoPi * i / size);
+    }
+
+    for (auto& channel : channels)
+    {
+        channel.inputRing.assign((size_t) maxSize, 0.0f);
+        channel.outputRing.assign((size_t) maxSize, 0.0f);
+        channel.frame.assign((size_t) (2 * maxSize), 0.0f);
+    }
+
+    // one block big enough for the history at any of the sizes
+    historyCapacity = 0;
+    for (int o = minOrder; o <= maxOrder; ++o)
+        historyCapacity = juce::jmax(historyCapacity, (size_t) getNumFrames(o, sampleRate) * (size_t) getHistoryStride(o));
+
+    historyMemory.allocate(historyCapacity * maxChannels * sizeof(float) + historyAlignment, false);
+    const auto address = reinterpret_cast<uintptr_t>(historyMemory.get());
+    history = reinterpret_cast<float*>((address + historyAlignment - 1) & ~(uintptr_t) (historyAlignment - 1));
+
+    setOrder(order);
+}
+
+void SpectralDelay::setOrder(int newOrder)
+{
+    order = juce::jlimit(minOrder, maxOrder, newOrder);
+    fftSize = 1 << order;
+    hopSize = fftSize / 4;
+    stride = getHistoryStride(order);
+    numBands = stride / (2 * binsPerBand);
+    numFrames = getNumFrames(order, sampleRate);
+    reset();
+}
+
+void SpectralDelay::reset()
+{
+    // only the part of the rings the current size reads, the history is megabytes and is never cleared
+    // on the audio thread: a band whose delayed frame hasn't been written since comes out silent instead
+    for (int c = 0; c < numPreparedChannels; ++c)
+    {
+        juce::FloatVectorOperations::clear(channels[c].inputRing.data(), fftSize);
+        juce::FloatVectorOperations::clear(channels[c].outputRing.data(), fftSize);
+    }
+
+    frameIndex = 0;
+    numFramesWritten = 0;
+    ringPos = 0;
+    hopCounter = 0;
+}
+
+void SpectralDelay::updateBands(const Settings& settings)
+{
+    // the wet is one FFT size late like the dry, so the hops only have to make up the delay time itself
+    const float baseFrames = settings.delaySamples / hopSize;
+    for (int b = 0; b < numBands; ++b)
+    {
+        const float position = numBands > 1 ? 2.0f * b / (numBands - 1) - 1.0f : 0.0f;
+        bandDelays[b] = juce::jlimit(1, numFrames - 1, juce::roundToInt(baseFrames * (1.0f + settings.tilt * position)));
+        bandFeedback[b] = settings.feedback * (1.0f - settings.damping * b / numBands);
+    }
+}
+
+void SpectralDelay::process(const float* const* input, float* const* dry, float* const* wet,
+    int numChannels, int numSamples, const Settings& settings)
+{
+    numChannels = juce::jmin(numChannels, numPreparedChannels);
+    updateBands(settings);
+
+    const int mask = fftSize - 1;
+    int done = 0;
+    while (done < numSamples)
+    {
+        // run up to the next hop, where a new frame is transformed
+        const int num = juce::jmin(numSamples - done, hopSize - hopCounter);
+
+        for (int c = 0; c < numChannels; ++c)
+        {
+            auto& channel = channels[c];
+            for (int i = 0; i < num; ++i)
+            {
+                const int index = (ringPos + i) & mask;
+                dry[c][done + i] = channel.inputRing[(size_t) index];
+                channel.inputRing[(size_t) index] = input[c][done + i];
+                wet[c][done + i] = channel.outputRing[(size_t) index];
+                channel.outputRing[(size_t) index] = 0.0f;
+            }
+        }
+
+        ringPos = (ringPos + num) & mask;
+        hopCounter += num;
+        done += num;
+
+        if (hopCounter == hopSize)
+        {
+            hopCounter = 0;
+            for (int c = 0; c < numChannels; ++c)
+                processFrame(c);
+            frameIndex = (frameIndex + 1) % numFrames;
+            numFramesWritten = juce::jmin(numFramesWritten + 1, numFrames);
+        }
+    }
+}
+
+void SpectralDelay::processFrame(int c)
+{
+    auto& channel = channels[c];
+    const auto& window = windows[order - minOrder];
+    const int mask = fftSize - 1;
+    float* frame = channel.frame.data();
+
+    // the ring position is the oldest input, so the frame comes out in order
+    for (int i = 0; i < fftSize; ++i)
+        frame[i] = channel.inputRing[(size_t) ((ringPos + i) & mask)] * window[(size_t) i];
+    juce::FloatVectorOperations::clear(frame + fftSize, fftSize);
+
+    ffts[order - minOrder]->performRealOnlyForwardTransform(frame, true);
+
+    // each band: the frame written bandDelays ago comes out, and goes back in with its feedback on top of the input
+    float* channelHistory = history + (size_t) c * historyCapacity;
+    float* current = channelHistory + (size_t) frameIndex * (size_t) stride;
+    const int bandFloats = 2 * binsPerBand;
+    for (int b = 0; b < numBands; ++b)
+    {
+        float* spectrum = frame + b * bandFloats;
+        float* written = current + b * bandFloats;
+        juce::FloatVectorOperations::copy(written, spectrum, bandFloats);
+
+        if (bandDelays[b] > numFramesWritten)
+        {
+            juce::FloatVectorOperations::clear(spectrum, bandFloats);
+            continue;
+        }
+
+        const int delayedIndex = (frameIndex - bandDelays[b] + numFrames) % numFrames;
+        const float* delayed = channelHistory + (size_t) delayedIndex * (size_t) stride + b * bandFloats;
+        juce::FloatVectorOperations::addWithMultiply(written, delayed, bandFeedback[b], bandFloats);
+        juce::FloatVectorOperations::copy(spectrum, delayed, bandFloats);
+    }
+
+    ffts[order - minOrder]->performRealOnlyInverseTransform(frame);
+
+    for (int i = 0; i < fftSize; ++i)
+        channel.outputRing[(size_t) ((ringPos + i) & mask)] += frame[i] * window[(size_t) i] * overlapGain;
+}
@@ -0,0 +1,87 @@
+/*
+  ==============================================================================
+
+    SpectralDelay.h
+
+    STFT delay with its own delay and feedback for each band of bins. Hann
+    windows at 75% overlap, so the output is one FFT size late; the input is
+    handed back delayed by the same amount so the dry signal can line up with it.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+class SpectralDelay
+{
+public:
+    static constexpr int minOrder = 9;   // 512
+    static constexpr int maxOrder = 11;  // 2048
+    static constexpr int maxChannels = 2;
+
+    // bins share a delay in bands of this many, which keeps each band one contiguous SIMD run
+    static constexpr int binsPerBand = 8;
+
+    struct Settings
+    {
+        float delaySamples{ 0.0f };
+        float feedback{ 0.0f };
+        float tilt{ 0.0f };     // -1 delays the low bands longer, +1 the high ones
+        float damping{ 0.0f };  // 1 takes the feedback of the top band to nothing
+    };
+
+    /** Allocates for every FFT size, so setOrder() can be called from the audio thread.
+        Neither it nor reset() clears the history, frames not written since are read as silence.
+    */
+    void prepare(int numChannels, double sampleRate);
+    void setOrder(int newOrder);
+    void reset();
+
+    int getOrder() const noexcept { return order; }
+    int getLatencySamples() const noexcept { return fftSize; }
+
+    /** dry gets the input delayed by getLatencySamples(), wet the spectral repeats. */
+    void process(const float* const* input, float* const* dry, float* const* wet,
+        int numChannels, int numSamples, const Settings& settings);
+
+private:
+    void processFrame(int channel);
+    void updateBands(const Settings& settings);
+    static int getNumFrames(int fftOrder, double sampleRate);
+    static int getHistoryStride(int fftOrder);
+
+    std::unique_ptr<juce::dsp::FFT> ffts[maxOrder - minOrder + 1];
+    std::vector<float> windows[maxOrder - minOrder + 1];
+
+    struct Channel
+    {
+        std::vector<float> inputRing;
+        std::vector<float> outputRing;
+        std::vector<float> frame;
+    };
+    Channel channels[maxChannels];
+    int numPreparedChannels{ 0 };
+
+    // [channel][frame][stride] spectra, complex interleaved, each frame cache line aligned
+    juce::HeapBlock<char> historyMemory;
+    float* history{ nullptr };
+    size_t historyCapacity{ 0 };  // floats per channel
+
+    double sampleRate{ 44100.0 };
+    int order{ 10 };
+    int fftSize{ 1024 };
+    int hopSize{ 256 };
+    int numBands{ 0 };
+    int stride{ 0 };
+    int numFrames{ 0 };
+    int frameIndex{ 0 };
+    int numFramesWritten{ 0 };  // since the last reset, up to numFrames
+    int ringPos{ 0 };
+    int hopCounter{ 0 };
+
+    static constexpr int maxBands = ((1 << maxOrder) / 2 + 1 + binsPerBand - 1) / binsPerBand;
+    int bandDelays[maxBands]{};
+    float bandFeedback[maxBands]{};
+};
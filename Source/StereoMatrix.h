@@ -0,0 +1,153 @@
+/*
+  ==============================================================================
+
+    StereoMatrix.h
+
+    2x2 gain matrix for the wet signal. Mid/side width, pan and the wet level
+    fold into one matrix, so the whole stage is a single pass over the samples.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "VectorOps.h"
+
+//==============================================================================
+/**
+    left  = ll * inLeft + lr * inRight
+    right = rl * inLeft + rr * inRight
+*/
+struct StereoMatrix
+{
+    float ll, lr, rl, rr;
+
+    /** Encodes to mid/side, scales the side by width (0 is mono, 1 leaves it as it
+        is, 2 is twice as wide), decodes again and applies the pan law and level.
+    */
+    static StereoMatrix fromWidthAndPan(float level, float width, float pan) noexcept
+    {
+        const float leftGain  = level * (pan <= 0.0f ? 1.0f : std::sqrt(1.0f - pan));
+        const float rightGain = level * (pan >= 0.0f ? 1.0f : std::sqrt(1.0f + pan));
+        const float direct = 0.5f * (1.0f + width);
+        const float cross  = 0.5f * (1.0f - width);
+        return { leftGain * direct, leftGain * cross, rightGain * cross, rightGain * direct };
+    }
+
+    static StereoMatrix silence() noexcept { return { 0.0f, 0.0f, 0.0f, 0.0f }; }
+
+    static StereoMatrix interpolate(const StereoMatrix& a, const StereoMatrix& b, float proportion) noexcept
+    {
+        return { a.ll + proportion * (b.ll - a.ll), a.lr + proportion * (b.lr - a.lr),
+                 a.rl + proportion * (b.rl - a.rl), a.rr + proportion * (b.rr - a.rr) };
+    }
+
+    // a mono signal is the same on both inputs, so it only sees the left row
+    float getMonoGain() const noexcept { return ll + lr; }
+
+    bool operator== (const StereoMatrix& other) const noexcept
+    {
+        return ll == other.ll && lr == other.lr && rl == other.rl && rr == other.rr;
+    }
+};
+
+namespace VectorOps
+{
+    /** Runs a stereo pair through a matrix that ramps from start to end over num samples.
+        The result replaces dest, or is added to it when accumulate is set. dest may be
+        the same as src. For mono, pass nullptr for both right channels.
+    */
+    inline void applyStereoMatrix(float* destLeft, float* destRight, const float* srcLeft, const float* srcRight,
+        int num, const StereoMatrix& start, const StereoMatrix& end, bool accumulate) noexcept
+    {
+        if (num <= 0)
+            return;
+
+        const float scale = 1.0f / num;
+
+        if (destRight == nullptr || srcRight == nullptr)
+        {
+            const float gain = start.getMonoGain();
+            const float step = (end.getMonoGain() - gain) * scale;
+            for (int i = 0; i < num; ++i)
+            {
+                const float out = (gain + step * i) * srcLeft[i];
+                destLeft[i] = accumulate ? destLeft[i] + out : out;
+            }
+            return;
+        }
+
+        const StereoMatrix step{ (end.ll - start.ll) * scale, (end.lr - start.lr) * scale,
+                                 (end.rl - start.rl) * scale, (end.rr - start.rr) * scale };
+        int i = 0;
+
+       #if DIGITALDELAY_USE_SSE
+        const __m128 ramp = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        __m128 ll = _mm_add_ps(_mm_set1_ps(start.ll), _mm_mul_ps(_mm_set1_ps(step.ll), ramp));
+        __m128 lr = _mm_add_ps(_mm_set1_ps(start.lr), _mm_mul_ps(_mm_set1_ps(step.lr), ramp));
+        __m128 rl = _mm_add_ps(_mm_set1_ps(start.rl), _mm_mul_ps(_mm_set1_ps(step.rl), ramp));
+        __m128 rr = _mm_add_ps(_mm_set1_ps(start.rr), _mm_mul_ps(_mm_set1_ps(step.rr), ramp));
+        const __m128 llStep = _mm_set1_ps(4.0f * step.ll), lrStep = _mm_set1_ps(4.0f * step.lr);
+        const __m128 rlStep = _mm_set1_ps(4.0f * step.rl), rrStep = _mm_set1_ps(4.0f * step.rr);
+
+        for (; i + 4 <= num; i += 4)
+        {
+            const __m128 left = _mm_loadu_ps(srcLeft + i);
+            const __m128 right = _mm_loadu_ps(srcRight + i);
+            __m128 outLeft = _mm_add_ps(_mm_mul_ps(ll, left), _mm_mul_ps(lr, right));
+            __m128 outRight = _mm_add_ps(_mm_mul_ps(rl, left), _mm_mul_ps(rr, right));
+            if (accumulate)
+            {
+                outLeft = _mm_add_ps(outLeft, _mm_loadu_ps(destLeft + i));
+                outRight = _mm_add_ps(outRight, _mm_loadu_ps(destRight + i));
+            }
+            _mm_storeu_ps(destLeft + i, outLeft);
+            _mm_storeu_ps(destRight + i, outRight);
+
+            ll = _mm_add_ps(ll, llStep);
+            lr = _mm_add_ps(lr, lrStep);
+            rl = _mm_add_ps(rl, rlStep);
+            rr = _mm_add_ps(rr, rrStep);
+        }
+       #elif DIGITALDELAY_USE_NEON
+        const float rampValues[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+        const float32x4_t ramp = vld1q_f32(rampValues);
+        float32x4_t ll = vmlaq_f32(vdupq_n_f32(start.ll), vdupq_n_f32(step.ll), ramp);
+        float32x4_t lr = vmlaq_f32(vdupq_n_f32(start.lr), vdupq_n_f32(step.lr), ramp);
+        float32x4_t rl = vmlaq_f32(vdupq_n_f32(start.rl), vdupq_n_f32(step.rl), ramp);
+        float32x4_t rr = vmlaq_f32(vdupq_n_f32(start.rr), vdupq_n_f32(step.rr), ramp);
+        const float32x4_t llStep = vdupq_n_f32(4.0f * step.ll), lrStep = vdupq_n_f32(4.0f * step.lr);
+        const float32x4_t rlStep = vdupq_n_f32(4.0f * step.rl), rrStep = vdupq_n_f32(4.0f * step.rr);
+
+        for (; i + 4 <= num; i += 4)
+        {
+            const float32x4_t left = vld1q_f32(srcLeft + i);
+            const float32x4_t right = vld1q_f32(srcRight + i);
+            float32x4_t outLeft = vmlaq_f32(vmulq_f32(ll, left), lr, right);
+            float32x4_t outRight = vmlaq_f32(vmulq_f32(rl, left), rr, right);
+            if (accumulate)
+            {
+                outLeft = vaddq_f32(outLeft, vld1q_f32(destLeft + i));
+                outRight = vaddq_f32(outRight, vld1q_f32(destRight + i));
+            }
+            vst1q_f32(destLeft + i, outLeft);
+            vst1q_f32(destRight + i, outRight);
+
+            ll = vaddq_f32(ll, llStep);
+            lr = vaddq_f32(lr, lrStep);
+            rl = vaddq_f32(rl, rlStep);
+            rr = vaddq_f32(rr, rrStep);
+        }
+       #endif
+
+        for (; i < num; ++i)
+        {
+            const float left = srcLeft[i];
+            const float right = srcRight[i];
+            const float outLeft = (start.ll + step.ll * i) * left + (start.lr + step.lr * i) * right;
+            const float outRight = (start.rl + step.rl * i) * left + (start.rr + step.rr * i) * right;
+            destLeft[i] = accumulate ? destLeft[i] + outLeft : outLeft;
+            destRight[i] = accumulate ? destRight[i] + outRight : outRight;
+        }
+    }
+}
@@ -0,0 +1,82 @@
+/*
+  ==============================================================================
+
+    VectorOps.h
+
+    Small SIMD kernels for the delay line that juce::FloatVectorOperations
+    doesn't cover. Each one has a plain scalar fallback.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+ #include <emmintrin.h>
+ #define DIGITALDELAY_USE_SSE 1
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+ #include <arm_neon.h>
+ #define DIGITALDELAY_USE_NEON 1
+#endif
+
+namespace VectorOps
+{
+    /** dest[i] += src[-i] * window[i]
+
+        src points at the newest sample of a contiguous run of at least num samples
+        and is walked backwards. The loads stay contiguous and the lanes are
+        reversed with a shuffle rather than gathering one index at a time.
+    */
+    inline void addReversedWithMultiply(float* dest, const float* src, const float* window, int num) noexcept
+    {
+        int i = 0;
+
+       #if DIGITALDELAY_USE_SSE
+        for (; i + 4 <= num; i += 4)
+        {
+            __m128 s = _mm_loadu_ps(src - i - 3);
+            s = _mm_shuffle_ps(s, s, _MM_SHUFFLE(0, 1, 2, 3));
+            const __m128 d = _mm_loadu_ps(dest + i);
+            _mm_storeu_ps(dest + i, _mm_add_ps(d, _mm_mul_ps(s, _mm_loadu_ps(window + i))));
+        }
+       #elif DIGITALDELAY_USE_NEON
+        for (; i + 4 <= num; i += 4)
+        {
+            float32x4_t s = vrev64q_f32(vld1q_f32(src - i - 3));
+            s = vcombine_f32(vget_high_f32(s), vget_low_f32(s));
+            vst1q_f32(dest + i, vmlaq_f32(vld1q_f32(dest + i), s, vld1q_f32(window + i)));
+        }
+       #endif
+
+        for (; i < num; ++i)
+            dest[i] += src[-i] * window[i];
+    }
+
+    /** Returns the sum of a[i] * b[i], four lanes at a time. */
+    inline float dotProduct(const float* a, const float* b, int num) noexcept
+    {
+        int i = 0;
+        float sum = 0.0f;
+
+       #if DIGITALDELAY_USE_SSE
+        __m128 acc = _mm_setzero_ps();
+        for (; i + 4 <= num; i += 4)
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+        acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(1, 1, 1, 1)));
+        sum = _mm_cvtss_f32(acc);
+       #elif DIGITALDELAY_USE_NEON
+        float32x4_t acc = vdupq_n_f32(0.0f);
+        for (; i + 4 <= num; i += 4)
+            acc = vmlaq_f32(acc, vld1q_f32(a + i), vld1q_f32(b + i));
+        const float32x2_t pair = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+        sum = vget_lane_f32(vpadd_f32(pair, pair), 0);
+       #endif
+
+        for (; i < num; ++i)
+            sum += a[i] * b[i];
+        return sum;
+    }
+}
@@ -0,0 +1,159 @@
+/*
+  ==============================================================================
+
+    WetCapture.cpp
+
+  ==============================================================================
+*/
+
+#include "WetCapture.h"
+
+WetCapture::WetCapture()
+    : juce::Thread("Wet capture drain")
+{
+}
+
+WetCapture::~WetCapture()
+{
+    stop();
+}
+
+void WetCapture::prepare(int newNumChannels, double newSampleRate)
+{
+    newNumChannels = juce::jlimit(1, maxChannels, newNumChannels);
+
+    // a running file can't change format halfway through
+    if (isCapturing() && (newNumChannels != numChannels || newSampleRate != sampleRate))
+        stop();
+
+    numChannels = newNumChannels;
+    sampleRate = newSampleRate;
+
+    // one second of headroom before the audio thread starts dropping samples
+    const int fifoSize = juce::roundToInt(sampleRate) + 1;
+    if (fifo.getTotalSize() != fifoSize || fifoBuffer.getNumChannels() != numChannels)
+    {
+        fifoBuffer.setSize(numChannels, fifoSize);
+        fifo.setTotalSize(fifoSize);
+    }
+
+    // a capture that carries on in the same format keeps its fifo, the drain thread is still reading it
+    if (! isCapturing())
+        fifo.reset();
+}
+
+bool WetCapture::start(const juce::File& file)
+{
+    stop();
+
+    file.getParentDirectory().createDirectory();
+    file.deleteFile();
+    std::unique_ptr<juce::FileOutputStream> stream(file.createOutputStream());
+    if (stream == nullptr || stream->failedToOpen())
+        return false;
+
+    std::unique_ptr<juce::AudioFormat> format;
+    if (file.hasFileExtension(".flac"))
+        format = std::make_unique<juce::FlacAudioFormat>();
+    else
+        format = std::make_unique<juce::WavAudioFormat>();
+
+    std::unique_ptr<juce::AudioFormatWriter> fileWriter(format->createWriterFor(stream.get(), sampleRate,
+        (unsigned int) numChannels, 24, {}, 0));
+    if (fileWriter == nullptr)
+        return false;
+    stream.release();
+
+    writer = std::make_unique<juce::AudioFormatWriter::ThreadedWriter>(fileWriter.release(), writerThread,
+        fifo.getTotalSize());
+    currentFile = file;
+    capturedSamples = 0;
+    droppedSamples = 0;
+
+    // stop() has waited out any push, and none starts writing until the flag goes up below
+    fifo.reset();
+
+    writerThread.startThread();
+    startThread();
+    capturing.store(true, std::memory_order_release);
+    return true;
+}
+
+void WetCapture::stop()
+{
+    if (writer == nullptr)
+        return;
+
+    capturing.store(false);
+    while (numPushesInProgress.load() > 0)
+        juce::Thread::yield();
+    stopThread(1000);
+
+    // whatever the audio thread pushed before it saw the flag still goes to the file
+    drain();
+    writer.reset();
+    writerThread.stopThread(1000);
+}
+
+void WetCapture::push(const juce::AudioBuffer<float>& wet, int numSamples)
+{
+    ++numPushesInProgress;
+    if (capturing.load())
+        writeToFifo(wet, numSamples);
+    --numPushesInProgress;
+}
+
+void WetCapture::writeToFifo(const juce::AudioBuffer<float>& wet, int numSamples)
+{
+    int start1, size1, start2, size2;
+    fifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+
+    for (int i = 0; i < numChannels; ++i)
+    {
+        const int sourceChannel = juce::jmin(i, wet.getNumChannels() - 1);
+        if (size1 > 0)
+            fifoBuffer.copyFrom(i, start1, wet, sourceChannel, 0, size1);
+        if (size2 > 0)
+            fifoBuffer.copyFrom(i, start2, wet, sourceChannel, size1, size2);
+    }
+    fifo.finishedWrite(size1 + size2);
+
+    if (size1 + size2 < numSamples)
+        droppedSamples += numSamples - (size1 + size2);
+}
+
+void WetCapture::run()
+{
+    while (! threadShouldExit())
+    {
+        drain();
+        wait(10);
+    }
+}
+
+void WetCapture::drain()
+{
+    int start1, size1, start2, size2;
+    fifo.prepareToRead(fifo.getNumReady(), start1, size1, start2, size2);
+
+    const float* channels[maxChannels];
+    int numRead = 0;
+
+    for (auto block : { std::make_pair(start1, size1), std::make_pair(start2, size2) })
+    {
+        if (block.second <= 0)
+            continue;
+
+        for (int i = 0; i < numChannels; ++i)
+            channels[i] = fifoBuffer.getReadPointer(i, block.first);
+
+        // the writer's own fifo is full, leave the rest here and let ours take the strain
+        if (! writer->write(channels, block.second))
+            break;
+
+        numRead += block.second;
+    }
+
+    fifo.finishedRead(numRead);
+    capturedSamples += numRead;
+}
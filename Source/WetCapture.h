@@ -0,0 +1,69 @@
+/*
+  ==============================================================================
+
+    WetCapture.h
+
+    Streams the wet-only return of the delay to a WAV or FLAC file while the
+    plugin is running.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    The audio thread only copies into a preallocated fifo. A background thread
+    drains the fifo into an AudioFormatWriter::ThreadedWriter, so nothing on the
+    audio thread ever waits on the disk. Samples that don't fit because the writer
+    fell behind are dropped and counted instead.
+*/
+class WetCapture  : private juce::Thread
+{
+public:
+    WetCapture();
+    ~WetCapture() override;
+
+    //==============================================================================
+    // call while the audio isn't running, e.g. from prepareToPlay
+    void prepare(int numChannels, double sampleRate);
+
+    // message thread, the file type is taken from the extension (.flac or .wav)
+    bool start(const juce::File& file);
+    void stop();
+    bool isCapturing() const noexcept { return capturing.load(std::memory_order_acquire); }
+    juce::File getFile() const { return currentFile; }
+
+    // audio thread, never blocks
+    void push(const juce::AudioBuffer<float>& wet, int numSamples);
+
+    juce::int64 getNumCapturedSamples() const noexcept { return capturedSamples.load(); }
+    juce::int64 getNumDroppedSamples() const noexcept  { return droppedSamples.load(); }
+
+private:
+    void run() override;
+    void drain();
+    void writeToFifo(const juce::AudioBuffer<float>& wet, int numSamples);
+
+    static constexpr int maxChannels = 2;
+
+    juce::AbstractFifo fifo{ 1 };
+    juce::AudioBuffer<float> fifoBuffer;
+    juce::TimeSliceThread writerThread{ "Wet capture writer" };
+    std::unique_ptr<juce::AudioFormatWriter::ThreadedWriter> writer;
+    juce::File currentFile;
+
+    // push() counts itself in before it checks the flag, so once stop() has lowered the flag and
+    // seen the count at zero nothing is left touching the fifo
+    std::atomic<bool> capturing{ false };
+    std::atomic<int> numPushesInProgress{ 0 };
+    std::atomic<juce::int64> capturedSamples{ 0 };
+    std::atomic<juce::int64> droppedSamples{ 0 };
+
+    int    numChannels{ maxChannels };
+    double sampleRate{ 44100.0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WetCapture)
+};
@@ -0,0 +1,68 @@
+/*
+  ==============================================================================
+
+    WindowTable.h
+
+    Precomputed Hann window and equal power fade, shared by the read kernels
+    that need one so nothing calls cos() or sin() per sample on the audio thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// a shape over a phase of 0 to 1, sampled once and linearly interpolated
+template <int tableSize>
+class InterpolatedTable
+{
+public:
+    static constexpr int size = tableSize;
+
+    float operator() (double phase) const noexcept
+    {
+        const double position = juce::jlimit(0.0, 1.0, phase) * size;
+        const int index = (int) position;
+        const float frac = (float) (position - index);
+        return table[index] + frac * (table[index + 1] - table[index]);
+    }
+
+    void fill(float* dest, double phase, double increment, int num) const noexcept
+    {
+        for (int i = 0; i < num; ++i)
+            dest[i] = (*this)(phase + increment * i);
+    }
+
+protected:
+    template <typename Shape>
+    explicit InterpolatedTable(Shape shape)
+    {
+        // one guard point past the end so the interpolation never needs to wrap
+        for (int i = 0; i <= size; ++i)
+            table[i] = shape((float) i / (float) size);
+        table[size + 1] = table[size];
+    }
+
+private:
+    float table[size + 2];
+};
+
+class WindowTable  : public InterpolatedTable<2048>
+{
+public:
+    WindowTable()
+        : InterpolatedTable<2048>([] (float phase) { return 0.5f - 0.5f * std::cos(juce::MathConstants<float>::twoPi * phase); })
+    {
+    }
+};
+
+// the fade in gain sin(phase * pi / 2), the matching fade out gain is the same table at 1 - phase
+class EqualPowerTable  : public InterpolatedTable<1024>
+{
+public:
+    EqualPowerTable()
+        : InterpolatedTable<1024>([] (float phase) { return std::sin(juce::MathConstants<float>::halfPi * phase); })
+    {
+    }
+};